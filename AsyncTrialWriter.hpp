@@ -0,0 +1,358 @@
+#pragma once
+#include "TrialSink.hpp"
+#include "BinaryIO.hpp"
+#include "StatsAccumulator.hpp"
+#include "Stopwatch.hpp"
+#include <vector>
+#include <deque>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <cstdio>
+#include <iostream>
+
+// line formats of an AsyncTrialWriter
+enum TrialStreamFormat {
+    STREAM_CSV,                   // one row per trial, header first
+    STREAM_JSONL,                 // one JSON object per trial
+    STREAM_CSV_BATCHES,           // one row per batch: its mean and the running mean
+    STREAM_JSONL_BATCHES          // one JSON object per batch
+};
+
+// Streams trial results as CSV or JSON lines while the run is going. The
+// run hands over each batch of records and moves on; a background thread
+// formats them and writes each batch with one write and one flush, so a
+// dashboard tailing the output sees whole lines as soon as a batch lands.
+// The run only waits if maxQueued batches are already waiting on slow output.
+// A file is replaced when the first run begins, unless a resumed run has
+// restored it from a checkpoint: then it is cut back to the checkpoint's
+// length and continued. Output to a plain stream cannot be taken back.
+class AsyncTrialWriter : public TrialSink {
+private:
+    std::unique_ptr<std::ofstream> file;
+    std::string path;
+    std::ostream& out;
+    TrialStreamFormat format;
+    size_t maxQueued;
+    
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<TrialRecord>> queue;
+    bool writing = false;                 // the thread holds a batch
+    bool done = false;
+    std::exception_ptr error;
+    std::thread thread;
+    
+    // only the writer thread touches these after begin()
+    double sites = 1.0;
+    bool headerDone = false;
+    StatsAccumulator running;
+    Stopwatch sinceBegin;
+    long long linesWritten = 0;           // under the mutex
+    bool started = false;                 // a run has begun or the file was restored
+    
+    static void appendNumber(std::string& text, const char* format, double value) {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), format, value);
+        text += buffer;
+    }
+    
+    void formatTrials(const std::vector<TrialRecord>& batch, std::string& text) {
+        bool csv = format == STREAM_CSV;
+        if (csv && !headerDone) {
+            text += "trial,seed,open_sites,threshold,mean_cluster_size,spanning_strength\n";
+            headerDone = true;
+        }
+        for (const auto& r : batch) {
+            double threshold = r.openSites / sites;
+            if (csv) {
+                text += std::to_string(r.trial) + "," + std::to_string(r.seed) + "," + std::to_string(r.openSites) + ",";
+                appendNumber(text, "%.9g", threshold);
+                appendNumber(text, ",%.9g", r.meanClusterSize);
+                appendNumber(text, ",%.9g\n", r.spanningStrength);
+            } else {
+                text += "{\"trial\":" + std::to_string(r.trial) + ",\"seed\":" + std::to_string(r.seed)
+                      + ",\"open_sites\":" + std::to_string(r.openSites);
+                appendNumber(text, ",\"threshold\":%.9g", threshold);
+                appendNumber(text, ",\"mean_cluster_size\":%.9g", r.meanClusterSize);
+                appendNumber(text, ",\"spanning_strength\":%.9g}\n", r.spanningStrength);
+            }
+        }
+    }
+    
+    void formatBatch(const std::vector<TrialRecord>& batch, std::string& text) {
+        bool csv = format == STREAM_CSV_BATCHES;
+        if (csv && !headerDone) {
+            text += "first_trial,trials,batch_mean,running_mean,trials_done,elapsed_seconds\n";
+            headerDone = true;
+        }
+        StatsAccumulator local;
+        for (const auto& r : batch) {
+            local.add(r.openSites / sites);
+        }
+        running.merge(local);
+        std::string first = std::to_string(batch.front().trial);
+        std::string count = std::to_string(batch.size());
+        std::string total = std::to_string(running.size());
+        if (csv) {
+            text += first + "," + count;
+            appendNumber(text, ",%.9g", local.mean());
+            appendNumber(text, ",%.9g,", running.mean());
+            text += total;
+            appendNumber(text, ",%.3f\n", sinceBegin.elapsedTime());
+        } else {
+            text += "{\"first_trial\":" + first + ",\"trials\":" + count;
+            appendNumber(text, ",\"batch_mean\":%.9g", local.mean());
+            appendNumber(text, ",\"running_mean\":%.9g", running.mean());
+            text += ",\"trials_done\":" + total;
+            appendNumber(text, ",\"elapsed_seconds\":%.3f}\n", sinceBegin.elapsedTime());
+        }
+    }
+    
+    void run() {
+        std::string text;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&]() { return done || !queue.empty(); });
+            if (queue.empty()) break;
+            std::vector<TrialRecord> batch = std::move(queue.front());
+            queue.pop_front();
+            writing = true;
+            changed.notify_all();
+            lock.unlock();
+            
+            bool perTrial = format == STREAM_CSV || format == STREAM_JSONL;
+            std::exception_ptr failed;
+            try {
+                text.clear();
+                if (perTrial) formatTrials(batch, text);
+                else formatBatch(batch, text);
+                out.write(text.data(), std::streamsize(text.size()));
+                out.flush();
+                if (!out) throw std::runtime_error("Failed writing trial stream");
+            } catch (...) {
+                failed = std::current_exception();
+            }
+            
+            lock.lock();
+            if (failed && !error) error = failed;
+            if (!failed) linesWritten += perTrial ? (long long)batch.size() : 1;
+            writing = false;
+            changed.notify_all();
+        }
+    }
+    
+    // rethrow a failure from the writer thread on the caller's thread
+    void rethrow() {
+        if (error) {
+            std::exception_ptr failed = error;
+            error = nullptr;
+            std::rethrow_exception(failed);
+        }
+    }
+
+public:
+    // out: not owned, e.g. std::cout; maxQueued: batches waiting before write() blocks
+    AsyncTrialWriter(std::ostream& out, TrialStreamFormat format, size_t maxQueued = 64)
+        : out(out), format(format), maxQueued(maxQueued) {
+        if (maxQueued == 0) {
+            throw std::invalid_argument("Writer queue must hold at least one batch");
+        }
+        thread = std::thread([this]() { run(); });
+    }
+    
+    AsyncTrialWriter(const std::string& path, TrialStreamFormat format, size_t maxQueued = 64)
+        : file(new std::ofstream(path, std::ios::app)), path(path), out(*file), format(format), maxQueued(maxQueued) {
+        if (!*file) {
+            throw std::runtime_error("Cannot open trial stream for writing: " + path);
+        }
+        if (maxQueued == 0) {
+            throw std::invalid_argument("Writer queue must hold at least one batch");
+        }
+        thread = std::thread([this]() { run(); });
+    }
+    
+    ~AsyncTrialWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        changed.notify_all();
+        thread.join();
+        if (error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+    
+    AsyncTrialWriter(const AsyncTrialWriter&) = delete;
+    AsyncTrialWriter& operator=(const AsyncTrialWriter&) = delete;
+    
+    // parses "csv", "jsonl", "csv-batches" or "jsonl-batches"
+    static TrialStreamFormat parseFormat(const std::string& name) {
+        if (name == "csv") return STREAM_CSV;
+        if (name == "jsonl") return STREAM_JSONL;
+        if (name == "csv-batches") return STREAM_CSV_BATCHES;
+        if (name == "jsonl-batches") return STREAM_JSONL_BATCHES;
+        throw std::invalid_argument("Unknown stream format: " + name + " (csv, jsonl, csv-batches, jsonl-batches)");
+    }
+    
+    void begin(int n, int trials, uint64_t runSeed) override {
+        (void)trials;
+        (void)runSeed;
+        flush();
+        if (file && !started) {
+            out.flush();
+            BinaryIO::truncateFile(path, 0);
+        }
+        started = true;
+        sites = double(n) * n;
+        running = StatsAccumulator();
+        sinceBegin.reset();
+    }
+    
+    // copies the records and returns; formatting and I/O happen on the writer thread
+    void write(const TrialRecord* records, size_t count) override {
+        if (count == 0) return;
+        std::vector<TrialRecord> batch(records, records + count);
+        std::unique_lock<std::mutex> lock(mutex);
+        rethrow();
+        changed.wait(lock, [&]() { return queue.size() < maxQueued; });
+        queue.push_back(std::move(batch));
+        changed.notify_all();
+    }
+    
+    // waits until every batch handed over so far is written and flushed
+    void flush() override {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return queue.empty() && !writing; });
+        rethrow();
+    }
+    
+    void saveState(std::ostream& state) override {
+        flush();
+        BinaryIO::write(state, file ? BinaryIO::fileSize(path) : uint64_t(0));
+        BinaryIO::write(state, uint8_t(headerDone));
+    }
+    
+    void restoreState(std::istream& state) override {
+        uint64_t length = BinaryIO::read<uint64_t>(state);
+        bool header = BinaryIO::read<uint8_t>(state) != 0;
+        flush();
+        if (file) {
+            out.flush();
+            BinaryIO::truncateFile(path, length);
+            headerDone = header;
+            started = true;
+        }
+    }
+    
+    // lines written so far (header excluded); exact after flush()
+    long long lines() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return linesWritten;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing AsyncTrialWriter class..." << std::endl;
+        
+        std::vector<TrialRecord> records;
+        for (int t = 0; t < 10; t++) {
+            records.push_back(TrialRecord{uint64_t(t), 100u + t, 50 + t % 3, 2.5, 0.125});
+        }
+        auto countLines = [](const std::string& text) {
+            size_t lines = 0;
+            for (char c : text) lines += c == '\n';
+            return lines;
+        };
+        
+        std::ostringstream csv;
+        {
+            AsyncTrialWriter writer(csv, STREAM_CSV);
+            writer.begin(10, 10, 1);
+            writer.write(records.data(), 6);
+            writer.write(records.data() + 6, 4);
+            writer.flush();
+            std::cout << "CSV trial lines: " << writer.lines() << " (expected: 10)" << std::endl;
+        }
+        std::string text = csv.str();
+        std::cout << "CSV lines with header: " << countLines(text) << " (expected: 11)" << std::endl;
+        std::cout << "CSV row in order: " << (text.find("\n9,109,50,0.5,2.5,0.125\n") != std::string::npos ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        std::ostringstream jsonl;
+        {
+            AsyncTrialWriter writer(jsonl, parseFormat("jsonl"));
+            writer.begin(10, 10, 1);
+            writer.write(records.data(), records.size());
+        }
+        text = jsonl.str();
+        std::cout << "JSON lines written on close: " << countLines(text) << " (expected: 10)" << std::endl;
+        std::cout << "JSON line: " << text.substr(0, text.find('\n')) << std::endl;
+        std::cout << "(expected: {\"trial\":0,\"seed\":100,\"open_sites\":50,\"threshold\":0.5,\"mean_cluster_size\":2.5,\"spanning_strength\":0.125})" << std::endl;
+        
+        std::ostringstream batches;
+        {
+            AsyncTrialWriter writer(batches, STREAM_JSONL_BATCHES, 1);
+            writer.begin(10, 10, 1);
+            for (int b = 0; b < 5; b++) {
+                writer.write(records.data() + 2 * b, 2);
+            }
+            writer.flush();
+            std::cout << "Batch lines: " << writer.lines() << " (expected: 5)" << std::endl;
+        }
+        text = batches.str();
+        std::cout << "Last batch has all trials: " << (text.find("\"trials_done\":10") != std::string::npos ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // A resumed file loses the rows written after its checkpoint, and its header is not repeated
+        std::string path = "asynctrialwriter_test.csv";
+        std::ostringstream state;
+        {
+            AsyncTrialWriter writer(path, STREAM_CSV);
+            writer.begin(10, 10, 1);
+            writer.write(records.data(), 6);
+            writer.saveState(state);
+            writer.write(records.data() + 6, 2);
+        }
+        {
+            AsyncTrialWriter resumed(path, STREAM_CSV);
+            std::istringstream checkpoint(state.str());
+            resumed.restoreState(checkpoint);
+            resumed.begin(10, 10, 1);
+            resumed.write(records.data() + 6, 4);
+        }
+        BinaryIO::readFile(path, text);
+        std::cout << "Resumed CSV lines with header: " << countLines(text) << " (expected: 11)" << std::endl;
+        std::cout << "Resumed CSV rows in order: "
+                  << (text.find("\n5,105,") != std::string::npos && text.find("\n6,106,") == text.rfind("\n6,106,") ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        {
+            AsyncTrialWriter fresh(path, STREAM_CSV);
+            fresh.begin(10, 10, 1);
+            fresh.write(records.data(), 1);
+        }
+        BinaryIO::readFile(path, text);
+        std::cout << "Fresh run replaces the file: " << countLines(text) << " lines (expected: 2 lines)" << std::endl;
+        std::remove(path.c_str());
+        
+        try {
+            parseFormat("xml");
+            std::cout << "ERROR: Should have thrown exception for unknown format" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "AsyncTrialWriter tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,535 @@
+#pragma once
+#include "BenchmarkRunner.hpp"
+#include "PerfCounters.hpp"
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+// one benchmark measurement as stored in a baseline file
+struct BaselineRecord {
+    std::string engine;
+    int n = 0;
+    int trials = 0;
+    uint64_t seed = 0;
+    int runs = 0;
+    double median = 0.0;                    // seconds
+    double mad = 0.0;
+    double min = 0.0;
+    std::vector<double> times;              // every measured run, seconds
+    std::map<std::string, double> counters; // counted hardware events per run
+    std::string host;
+    std::string cpu;
+    std::string compiler;
+    int cores = 0;
+    long long timestamp = 0;                // seconds since the epoch
+};
+
+// one (engine, n, trials) point of a baseline against a fresh run
+struct BaselineComparison {
+    std::string engine;
+    int n;
+    int trials;
+    double baseMedian;
+    double currentMedian;
+    double ratio;              // current / baseline median
+    double pValue;             // one-sided: current runs slower than baseline runs
+    bool regression;           // significant and at least minSlowdown slower
+    bool improvement;          // significant and at least minSlowdown faster
+    std::string mismatch;      // non-empty: only records from another host, cpu or compiler; not tested
+};
+
+// Machine-readable benchmark results: records are appended to a JSON-lines
+// file (one object per line, so runs accumulate and diff cleanly) and a
+// fresh run is compared against the latest stored record for each point.
+// A slowdown is flagged only when a one-sided Mann-Whitney test on the
+// individual run times rejects at the chosen level and the medians differ
+// by more than a minimum ratio, so noise between runs is not reported.
+// Only records from the same host, cpu and compiler are compared; a point
+// whose baseline was measured elsewhere is reported as not comparable.
+class BenchmarkBaseline {
+private:
+    double significance;
+    double minSlowdown;
+    
+    static std::string quote(const std::string& text) {
+        std::string out = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+    
+    // what differs between the environments two records were measured in; empty if none
+    static std::string environmentMismatch(const BaselineRecord& a, const BaselineRecord& b) {
+        std::string differs;
+        if (a.host != b.host) differs += "host";
+        if (a.cpu != b.cpu) differs += differs.empty() ? "cpu" : ", cpu";
+        if (a.compiler != b.compiler) differs += differs.empty() ? "compiler" : ", compiler";
+        return differs;
+    }
+    
+    // Reader for the flat objects this class writes: string, number,
+    // number-array and string-to-number object values
+    class Reader {
+    private:
+        const std::string& text;
+        size_t pos = 0;
+        
+        void fail(const std::string& what) const {
+            throw std::runtime_error("Baseline record, offset " + std::to_string(pos) + ": " + what);
+        }
+        
+        void skipSpace() {
+            while (pos < text.size() && std::isspace((unsigned char)text[pos])) pos++;
+        }
+    
+    public:
+        explicit Reader(const std::string& text) : text(text) {}
+        
+        bool consume(char c) {
+            skipSpace();
+            if (pos < text.size() && text[pos] == c) {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+        
+        void expect(char c) {
+            if (!consume(c)) fail(std::string("expected '") + c + "'");
+        }
+        
+        char peek() {
+            skipSpace();
+            return pos < text.size() ? text[pos] : '\0';
+        }
+        
+        bool atEnd() {
+            skipSpace();
+            return pos == text.size();
+        }
+        
+        std::string string() {
+            expect('"');
+            std::string out;
+            while (pos < text.size() && text[pos] != '"') {
+                char c = text[pos++];
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (pos >= text.size()) break;
+                char e = text[pos++];
+                if (e == 'u' && pos + 4 <= text.size()) {
+                    out += char(std::stoi(text.substr(pos, 4), nullptr, 16));
+                    pos += 4;
+                } else {
+                    out += e == 'n' ? '\n' : e == 't' ? '\t' : e;
+                }
+            }
+            expect('"');
+            return out;
+        }
+        
+        double number() {
+            skipSpace();
+            const char* start = text.c_str() + pos;
+            char* end = nullptr;
+            double value = std::strtod(start, &end);
+            if (end == start) fail("expected a number");
+            pos += size_t(end - start);
+            return value;
+        }
+        
+        // full 64-bit range, which a double would round
+        uint64_t unsignedNumber() {
+            skipSpace();
+            const char* start = text.c_str() + pos;
+            char* end = nullptr;
+            unsigned long long value = std::strtoull(start, &end, 10);
+            if (end == start) fail("expected an unsigned integer");
+            pos += size_t(end - start);
+            return uint64_t(value);
+        }
+    };
+
+public:
+    // significance: test level; minSlowdown: smallest median change reported (0.05 = 5%)
+    explicit BenchmarkBaseline(double significance = 0.01, double minSlowdown = 0.05)
+        : significance(significance), minSlowdown(minSlowdown) {
+        if (significance <= 0.0 || significance >= 1.0) {
+            throw std::invalid_argument("Significance level must be in (0, 1)");
+        }
+        if (minSlowdown < 0.0) {
+            throw std::invalid_argument("Minimum slowdown must not be negative");
+        }
+    }
+    
+    // a record for one benchmark result, stamped with this host
+    static BaselineRecord record(const std::string& engine, int n, int trials, uint64_t seed, const BenchmarkResult& result) {
+        BaselineRecord rec;
+        rec.engine = engine;
+        rec.n = n;
+        rec.trials = trials;
+        rec.seed = seed;
+        rec.runs = result.runs;
+        rec.median = result.median;
+        rec.mad = result.mad;
+        rec.min = result.min;
+        rec.times = result.times;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (result.events.counted[e]) rec.counters[PerfReading::name(e)] = result.events.values[e];
+        }
+
+#if defined(__linux__)
+        char name[256] = {0};
+        if (gethostname(name, sizeof(name) - 1) == 0) rec.host = name;
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.compare(0, 10, "model name") != 0) continue;
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) rec.cpu = line.substr(line.find_first_not_of(' ', colon + 1));
+            break;
+        }
+#endif
+#if defined(__VERSION__)
+        rec.compiler = __VERSION__;
+#endif
+#ifdef PERCOLATION_COUNTERS
+        rec.compiler += " +counters";
+#endif
+        rec.cores = int(std::thread::hardware_concurrency());
+        rec.timestamp = (long long)std::time(nullptr);
+        return rec;
+    }
+    
+    // one line of JSON, no trailing newline
+    static std::string toJson(const BaselineRecord& rec) {
+        std::ostringstream out;
+        out << std::setprecision(9);
+        out << "{\"engine\":" << quote(rec.engine) << ",\"n\":" << rec.n << ",\"trials\":" << rec.trials
+            << ",\"seed\":" << rec.seed << ",\"runs\":" << rec.runs
+            << ",\"median\":" << rec.median << ",\"mad\":" << rec.mad << ",\"min\":" << rec.min << ",\"times\":[";
+        for (size_t i = 0; i < rec.times.size(); i++) {
+            out << (i ? "," : "") << rec.times[i];
+        }
+        out << "],\"counters\":{";
+        bool first = true;
+        for (const auto& counter : rec.counters) {
+            out << (first ? "" : ",") << quote(counter.first) << ":" << counter.second;
+            first = false;
+        }
+        out << "},\"host\":" << quote(rec.host) << ",\"cpu\":" << quote(rec.cpu) << ",\"compiler\":" << quote(rec.compiler)
+            << ",\"cores\":" << rec.cores << ",\"timestamp\":" << rec.timestamp << "}";
+        return out.str();
+    }
+    
+    // parses one line written by toJson; unknown keys are skipped
+    static BaselineRecord fromJson(const std::string& line) {
+        BaselineRecord rec;
+        Reader in(line);
+        in.expect('{');
+        if (in.consume('}')) return rec;
+        do {
+            std::string key = in.string();
+            in.expect(':');
+            if (key == "times") {
+                in.expect('[');
+                if (!in.consume(']')) {
+                    do rec.times.push_back(in.number()); while (in.consume(','));
+                    in.expect(']');
+                }
+            } else if (key == "counters") {
+                in.expect('{');
+                if (!in.consume('}')) {
+                    do {
+                        std::string name = in.string();
+                        in.expect(':');
+                        rec.counters[name] = in.number();
+                    } while (in.consume(','));
+                    in.expect('}');
+                }
+            } else if (key == "seed") {
+                rec.seed = in.unsignedNumber();
+            } else if (in.peek() == '"') {
+                std::string value = in.string();
+                if (key == "engine") rec.engine = value;
+                else if (key == "host") rec.host = value;
+                else if (key == "cpu") rec.cpu = value;
+                else if (key == "compiler") rec.compiler = value;
+            } else {
+                double value = in.number();
+                if (key == "n") rec.n = int(value);
+                else if (key == "trials") rec.trials = int(value);
+                else if (key == "runs") rec.runs = int(value);
+                else if (key == "median") rec.median = value;
+                else if (key == "mad") rec.mad = value;
+                else if (key == "min") rec.min = value;
+                else if (key == "cores") rec.cores = int(value);
+                else if (key == "timestamp") rec.timestamp = (long long)value;
+            }
+        } while (in.consume(','));
+        in.expect('}');
+        if (!in.atEnd()) {
+            throw std::runtime_error("Baseline record: trailing characters");
+        }
+        return rec;
+    }
+    
+    // appends records to a JSON-lines file, creating it if needed
+    static void append(const std::string& path, const std::vector<BaselineRecord>& records) {
+        std::ofstream out(path, std::ios::app);
+        if (!out) {
+            throw std::runtime_error("Cannot open baseline file for writing: " + path);
+        }
+        for (const auto& rec : records) {
+            out << toJson(rec) << '\n';
+        }
+        if (!out) {
+            throw std::runtime_error("Failed writing baseline file: " + path);
+        }
+    }
+    
+    // every record in a JSON-lines file, in file order; blank lines are skipped
+    static std::vector<BaselineRecord> load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            throw std::runtime_error("Cannot open baseline file: " + path);
+        }
+        std::vector<BaselineRecord> records;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line)) {
+            lineNumber++;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            try {
+                records.push_back(fromJson(line));
+            } catch (const std::exception& e) {
+                throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " + e.what());
+            }
+        }
+        return records;
+    }
+    
+    // One-sided Mann-Whitney p-value that values in b tend to exceed those
+    // in a. Exact over all arrangements when there are no ties and the
+    // samples are small, normal approximation with tie correction otherwise.
+    static double mannWhitneyGreater(const std::vector<double>& a, const std::vector<double>& b) {
+        int na = int(a.size()), nb = int(b.size());
+        if (na == 0 || nb == 0) return 1.0;
+        
+        // U counts (a, b) pairs with b above a, ties as one half
+        double u = 0.0;
+        bool ties = false;
+        for (double x : a) {
+            for (double y : b) {
+                if (y > x) u += 1.0;
+                else if (y == x) {
+                    u += 0.5;
+                    ties = true;
+                }
+            }
+        }
+        
+        if (!ties && na <= 30 && nb <= 30) {
+            // ways[k][m][s]: arrangements of k a's and m b's with U = s,
+            // rolled into one table over m for each k
+            int maxU = na * nb;
+            std::vector<std::vector<double>> ways(nb + 1, std::vector<double>(maxU + 1, 0.0));
+            for (int m = 0; m <= nb; m++) ways[m][0] = 1.0;
+            for (int k = 1; k <= na; k++) {
+                std::vector<std::vector<double>> next(nb + 1, std::vector<double>(maxU + 1, 0.0));
+                next[0][0] = 1.0;
+                for (int m = 1; m <= nb; m++) {
+                    for (int s = 0; s <= k * m; s++) {
+                        // last element is a b (above all k a's) or an a (above none)
+                        next[m][s] = (s >= k ? next[m - 1][s - k] : 0.0) + ways[m][s];
+                    }
+                }
+                ways.swap(next);
+            }
+            double total = 0.0, tail = 0.0;
+            for (int s = 0; s <= maxU; s++) {
+                total += ways[nb][s];
+                if (s >= int(u)) tail += ways[nb][s];
+            }
+            return tail / total;
+        }
+        
+        // Normal approximation with continuity and tie corrections
+        std::vector<double> pooled(a);
+        pooled.insert(pooled.end(), b.begin(), b.end());
+        std::sort(pooled.begin(), pooled.end());
+        double tieTerm = 0.0;
+        for (size_t i = 0; i < pooled.size();) {
+            size_t j = i;
+            while (j < pooled.size() && pooled[j] == pooled[i]) j++;
+            double t = double(j - i);
+            tieTerm += t * t * t - t;
+            i = j;
+        }
+        double total = double(na + nb);
+        double mean = na * nb / 2.0;
+        double variance = na * nb / 12.0 * ((total + 1.0) - tieTerm / (total * (total - 1.0)));
+        if (variance <= 0.0) return 1.0;
+        double z = (u - mean - 0.5) / std::sqrt(variance);
+        return 0.5 * std::erfc(z / std::sqrt(2.0));
+    }
+    
+    // Each current record against the latest baseline record with the same
+    // engine, n and trials from the same host, cpu and compiler. Points
+    // measured only elsewhere are returned untested with the mismatch named;
+    // points missing from the baseline are skipped
+    std::vector<BaselineComparison> compare(const std::vector<BaselineRecord>& baseline,
+                                            const std::vector<BaselineRecord>& current) const {
+        std::vector<BaselineComparison> comparisons;
+        for (const auto& now : current) {
+            const BaselineRecord* base = nullptr;
+            const BaselineRecord* elsewhere = nullptr;
+            for (const auto& rec : baseline) {
+                if (rec.engine != now.engine || rec.n != now.n || rec.trials != now.trials || rec.median <= 0.0) continue;
+                if (environmentMismatch(rec, now).empty()) base = &rec;
+                else elsewhere = &rec;
+            }
+            if (base == nullptr && elsewhere == nullptr) continue;
+            
+            BaselineComparison c;
+            c.engine = now.engine;
+            c.n = now.n;
+            c.trials = now.trials;
+            c.regression = false;
+            c.improvement = false;
+            if (base == nullptr) {
+                c.baseMedian = elsewhere->median;
+                c.currentMedian = now.median;
+                c.ratio = now.median / elsewhere->median;
+                c.pValue = 1.0;
+                c.mismatch = environmentMismatch(*elsewhere, now);
+                comparisons.push_back(c);
+                continue;
+            }
+            c.baseMedian = base->median;
+            c.currentMedian = now.median;
+            c.ratio = now.median / base->median;
+            c.pValue = mannWhitneyGreater(base->times, now.times);
+            double fasterP = mannWhitneyGreater(now.times, base->times);
+            c.regression = c.pValue < significance && c.ratio > 1.0 + minSlowdown;
+            c.improvement = fasterP < significance && c.ratio < 1.0 / (1.0 + minSlowdown);
+            comparisons.push_back(c);
+        }
+        return comparisons;
+    }
+    
+    static bool anyRegression(const std::vector<BaselineComparison>& comparisons) {
+        for (const auto& c : comparisons) {
+            if (c.regression) return true;
+        }
+        return false;
+    }
+    
+    // one row per compared point
+    static void print(std::ostream& out, const std::vector<BaselineComparison>& comparisons) {
+        out << std::left << std::setw(22) << "engine" << std::right << std::setw(7) << "n" << std::setw(8) << "trials"
+            << std::setw(14) << "baseline (s)" << std::setw(14) << "current (s)" << std::setw(9) << "ratio"
+            << std::setw(11) << "p (slower)" << "  verdict" << std::endl;
+        out << std::string(96, '-') << std::endl;
+        for (const auto& c : comparisons) {
+            out << std::left << std::setw(22) << c.engine << std::right << std::setw(7) << c.n << std::setw(8) << c.trials
+                << std::fixed << std::setprecision(6) << std::setw(14) << c.baseMedian << std::setw(14) << c.currentMedian
+                << std::setprecision(3) << std::setw(8) << c.ratio << "x";
+            if (!c.mismatch.empty()) {
+                out << std::setw(11) << "-" << "  not comparable (" << c.mismatch << " differs)" << std::endl;
+                continue;
+            }
+            out << std::setprecision(4) << std::setw(11) << c.pValue
+                << "  " << (c.regression ? "REGRESSION" : c.improvement ? "faster" : "ok") << std::endl;
+        }
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing BenchmarkBaseline class..." << std::endl;
+        
+        BenchmarkResult result{"wqu", 3, 0.2, 0.01, 0.19, 0.05, false, PerfReading(), {0.21, 0.19, 0.2}};
+        result.events.counted[PERF_CYCLES] = true;
+        result.events.values[PERF_CYCLES] = 1.5e9;
+        BaselineRecord rec = record("Weighted Quick-Union", 200, 100, 0xfedcba9876543210ULL, result);
+        rec.host = "bench \"host\"";
+        BaselineRecord back = fromJson(toJson(rec));
+        std::cout << "Round trip keeps engine, seed and host: "
+                  << (back.engine == rec.engine && back.seed == 0xfedcba9876543210ULL && back.host == rec.host ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Round trip keeps times and counters: "
+                  << (back.times == rec.times && back.counters["cycles"] == 1.5e9 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // Exact test: 5 vs 5 fully separated gives 1 / C(10, 5)
+        std::vector<double> fast = {1.00, 1.01, 1.02, 1.03, 1.04};
+        std::vector<double> slow = {1.20, 1.21, 1.22, 1.23, 1.24};
+        std::cout << "Mann-Whitney p, separated 5 vs 5: " << std::setprecision(6) << mannWhitneyGreater(fast, slow)
+                  << " (expected: " << 1.0 / 252 << ")" << std::endl;
+        std::cout << "Mann-Whitney p, reversed: " << mannWhitneyGreater(slow, fast) << " (expected: 1)" << std::endl;
+        
+        auto asRecord = [](const std::vector<double>& times) {
+            BaselineRecord r;
+            r.engine = "wqu";
+            r.n = 200;
+            r.trials = 100;
+            r.times = times;
+            r.median = BenchmarkRunner::median(times);
+            return r;
+        };
+        std::vector<double> noisy = {1.00, 1.03, 1.01, 1.04, 1.02};
+        BenchmarkBaseline checker(0.01, 0.05);
+        std::cout << "20% slowdown flagged: " << (checker.compare({asRecord(fast)}, {asRecord(slow)})[0].regression ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        std::cout << "Same distribution flagged: " << (checker.compare({asRecord(fast)}, {asRecord(noisy)})[0].regression ? "true" : "false")
+                  << " (expected: false)" << std::endl;
+        std::cout << "Speedup reported as improvement: "
+                  << (checker.compare({asRecord(slow)}, {asRecord(fast)})[0].improvement ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // A baseline from another compiler is named, not tested; a matching record is preferred even if older
+        BaselineRecord otherBuild = asRecord(fast);
+        otherBuild.compiler = "other compiler +counters";
+        BaselineComparison untested = checker.compare({otherBuild}, {asRecord(slow)})[0];
+        std::cout << "Other-compiler baseline: " << (untested.regression ? "REGRESSION" : untested.mismatch)
+                  << " (expected: compiler)" << std::endl;
+        BaselineComparison matched = checker.compare({asRecord(fast), otherBuild}, {asRecord(slow)})[0];
+        std::cout << "Same-environment record used: " << (matched.mismatch.empty() && matched.regression ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        try {
+            fromJson("{\"engine\":\"wqu\",\"n\":");
+            std::cout << "ERROR: Should have thrown exception for a truncated record" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Correctly caught runtime error: " << e.what() << std::endl;
+        }
+        
+        std::cout << "BenchmarkBaseline tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,212 @@
+#pragma once
+#include "Stopwatch.hpp"
+#include "WorkerPool.hpp"
+#include "PerfCounters.hpp"
+#include "Tracer.hpp"
+#include <vector>
+#include <memory>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+// how a benchmark is measured
+struct BenchmarkOptions {
+    bool pin = true;                     // pin the measuring thread to one core
+    int pinCpu = -1;                     // core to pin to (-1 = first allowed core)
+    int warmupRuns = 1;                  // untimed runs before measuring
+    int minRuns = 3;                     // measured runs always taken
+    int maxRuns = 15;                    // stop repeating after this many runs
+    double targetRelativeError = 0.02;   // stop once the median is known this well
+    double timeLimit = 60.0;             // any single run slower than this aborts the benchmark
+    double maxSeconds = 180.0;           // stop repeating once measured runs took this long
+    bool countEvents = false;            // collect hardware counters over the measured runs
+    Tracer* tracer = nullptr;            // trace every warmup and measured run (not owned)
+};
+
+// summary of one benchmark
+struct BenchmarkResult {
+    std::string name;
+    int runs;                  // measured runs taken
+    double median;             // seconds
+    double mad;                // median absolute deviation, seconds
+    double min;                // fastest run, seconds
+    double relativeError;      // estimated standard error of the median / median
+    bool timedOut;             // a run exceeded timeLimit; timings are not valid
+    PerfReading events;        // hardware counters per measured run (countEvents only)
+    std::vector<double> times; // every measured run, seconds, in order
+};
+
+// Runs a piece of work repeatedly on a pinned core, after warmup, until the
+// median time is known to the requested relative error.
+class BenchmarkRunner {
+private:
+    BenchmarkOptions options;
+    TraceBuffer* trace = nullptr;        // registered on the first traced run
+    
+    // Standard error of the median, from MAD scaled to a normal sigma
+    static double relativeErrorOf(double median, double mad, int runs) {
+        if (median <= 0.0 || runs <= 1) return 0.0;
+        double sigma = 1.4826 * mad;
+        return 1.2533 * sigma / std::sqrt(double(runs)) / median;
+    }
+
+public:
+    explicit BenchmarkRunner(const BenchmarkOptions& options = BenchmarkOptions()) : options(options) {
+        if (options.minRuns <= 0 || options.maxRuns < options.minRuns) {
+            throw std::invalid_argument("Benchmark needs 0 < minRuns <= maxRuns");
+        }
+        if (options.warmupRuns < 0) {
+            throw std::invalid_argument("Warmup runs must not be negative");
+        }
+    }
+    
+    static double median(std::vector<double> values) {
+        if (values.empty()) return 0.0;
+        size_t mid = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + mid, values.end());
+        double upper = values[mid];
+        if (values.size() % 2 == 1) return upper;
+        double lower = *std::max_element(values.begin(), values.begin() + mid);
+        return (lower + upper) / 2.0;
+    }
+    
+    static double medianAbsoluteDeviation(const std::vector<double>& values, double center) {
+        std::vector<double> deviations;
+        deviations.reserve(values.size());
+        for (double value : values) {
+            deviations.push_back(std::fabs(value - center));
+        }
+        return median(deviations);
+    }
+    
+    // time work() under the runner's options
+    template <typename Work>
+    BenchmarkResult run(const std::string& name, Work work) {
+        BenchmarkResult result{name, 0, 0.0, 0.0, 0.0, 0.0, false, PerfReading(), {}};
+        const char* spanName = "";
+        if (options.tracer) {
+            if (trace == nullptr) trace = options.tracer->thread("benchmark");
+            spanName = options.tracer->intern(name);
+        }
+        
+        // Pin for the duration of the benchmark only
+        std::vector<int> previousAffinity = WorkerPool::currentAffinity();
+        if (options.pin && !previousAffinity.empty()) {
+            WorkerPool::pinCurrentThread(options.pinCpu >= 0 ? options.pinCpu : previousAffinity.front());
+        }
+        
+        for (int i = 0; i < options.warmupRuns; i++) {
+            TraceSpan span(trace, spanName, "warmup", i);
+            Stopwatch sw;
+            work();
+            if (sw.elapsedTime() > options.timeLimit) {
+                result.timedOut = true;
+                break;
+            }
+        }
+        
+        // Counters are only enabled around measured runs
+        std::unique_ptr<PerfCounters> counters;
+        if (options.countEvents) counters.reset(new PerfCounters());
+        
+        std::vector<double> times;
+        double spent = 0.0;
+        while (!result.timedOut && int(times.size()) < options.maxRuns) {
+            if (counters) counters->start();
+            double elapsed;
+            {
+                TraceSpan span(trace, spanName, "benchmark", int(times.size()));
+                Stopwatch sw;
+                work();
+                elapsed = sw.elapsedTime();
+            }
+            if (counters) {
+                counters->stop();
+                result.events.add(counters->read());
+            }
+            if (elapsed > options.timeLimit) {
+                result.timedOut = true;
+                break;
+            }
+            times.push_back(elapsed);
+            spent += elapsed;
+            
+            if (int(times.size()) >= options.minRuns) {
+                double center = median(times);
+                double error = relativeErrorOf(center, medianAbsoluteDeviation(times, center), int(times.size()));
+                if (error <= options.targetRelativeError || spent >= options.maxSeconds) break;
+            }
+        }
+        
+        if (options.pin && !previousAffinity.empty()) {
+            WorkerPool::setCurrentAffinity(previousAffinity);
+        }
+        
+        if (!times.empty()) {
+            result.runs = int(times.size());
+            result.median = median(times);
+            result.mad = medianAbsoluteDeviation(times, result.median);
+            result.min = *std::min_element(times.begin(), times.end());
+            result.relativeError = relativeErrorOf(result.median, result.mad, result.runs);
+            result.events = result.events.per(double(times.size()));
+            result.times = times;
+        }
+        return result;
+    }
+    
+    // one line per result: name, runs, median, MAD, min
+    static void print(std::ostream& out, const BenchmarkResult& result) {
+        out << std::left << std::setw(28) << result.name << std::right;
+        if (result.timedOut) {
+            out << "  timed out" << std::endl;
+            return;
+        }
+        out << std::fixed << std::setprecision(6)
+            << "  runs=" << std::setw(3) << result.runs
+            << "  median=" << result.median << "s"
+            << "  mad=" << result.mad << "s"
+            << "  min=" << result.min << "s"
+            << "  rel.err=" << std::setprecision(3) << 100.0 * result.relativeError << "%" << std::endl;
+        if (result.events.any() || !result.events.unavailable.empty()) {
+            out << std::string(28, ' ') << "  per run: ";
+            result.events.print(out);
+        }
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing BenchmarkRunner class..." << std::endl;
+        
+        std::cout << "Median of {3,1,2}: " << median({3, 1, 2}) << " (expected: 2)" << std::endl;
+        std::cout << "Median of {4,1,3,2}: " << median({4, 1, 3, 2}) << " (expected: 2.5)" << std::endl;
+        std::cout << "MAD of {1,2,3,4,100}: " << medianAbsoluteDeviation({1, 2, 3, 4, 100}, 3) << " (expected: 1)" << std::endl;
+        
+        BenchmarkOptions quick;
+        quick.minRuns = 3;
+        quick.maxRuns = 5;
+        int calls = 0;
+        BenchmarkRunner runner(quick);
+        BenchmarkResult result = runner.run("counting", [&]() { calls++; });
+        std::cout << "Runs within bounds: " << (result.runs >= 3 && result.runs <= 5 ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Warmup run included in calls: " << (calls == result.runs + 1 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        BenchmarkOptions strict;
+        strict.timeLimit = -1.0;
+        BenchmarkResult timedOut = BenchmarkRunner(strict).run("too slow", []() {});
+        std::cout << "Run over time limit reported: " << (timedOut.timedOut ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        try {
+            BenchmarkOptions invalid;
+            invalid.minRuns = 0;
+            BenchmarkRunner bad(invalid);
+            std::cout << "ERROR: Should have thrown exception for invalid run counts" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "BenchmarkRunner tests completed." << std::endl;
+    }
+};
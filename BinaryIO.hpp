@@ -0,0 +1,204 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <stdexcept>
+#include <type_traits>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Raw binary values in host byte order, for files read back on the same
+// kind of machine (checkpoints, trial files), and crash-safe file replacement
+class BinaryIO {
+public:
+    template <typename T>
+    static void write(std::ostream& out, const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "BinaryIO writes plain values only");
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    
+    // throws std::runtime_error when the stream ends early
+    template <typename T>
+    static T read(std::istream& in) {
+        static_assert(std::is_trivially_copyable<T>::value, "BinaryIO reads plain values only");
+        T value;
+        if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+            throw std::runtime_error("Unexpected end of binary data");
+        }
+        return value;
+    }
+    
+    // Replace path with bytes so that a crash at any point leaves either the
+    // old file or the new one: write a temporary beside it, flush it to disk,
+    // then rename it over the original
+    static void replaceFile(const std::string& path, const std::string& bytes) {
+        std::string temp = path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                throw std::runtime_error("Cannot open file for writing: " + temp);
+            }
+            out.write(bytes.data(), std::streamsize(bytes.size()));
+            out.close();
+            if (!out) {
+                throw std::runtime_error("Failed writing file: " + temp);
+            }
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(temp.c_str(), O_RDONLY);
+        if (fd < 0 || ::fsync(fd) != 0) {
+            if (fd >= 0) ::close(fd);
+            throw std::runtime_error("Cannot flush file to disk: " + temp);
+        }
+        ::close(fd);
+#endif
+        if (std::rename(temp.c_str(), path.c_str()) != 0) {
+            std::remove(temp.c_str());
+            throw std::runtime_error("Cannot replace file: " + path);
+        }
+    }
+    
+    // whole file as bytes; false if it does not exist or cannot be read
+    static bool readFile(const std::string& path, std::string& bytes) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        bytes = contents.str();
+        return true;
+    }
+    
+    // bytes in a file; 0 if it does not exist
+    static uint64_t fileSize(const std::string& path) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return 0;
+        return uint64_t(in.tellg());
+    }
+    
+    // Cut a file back to its first length bytes, e.g. output written after a checkpoint
+    static void truncateFile(const std::string& path, uint64_t length) {
+        if (fileSize(path) < length) {
+            throw std::runtime_error("File is shorter than expected: " + path);
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        if (::truncate(path.c_str(), off_t(length)) != 0) {
+            throw std::runtime_error("Cannot truncate file: " + path);
+        }
+#else
+        std::string bytes;
+        if (!readFile(path, bytes)) {
+            throw std::runtime_error("Cannot read file: " + path);
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), std::streamsize(length));
+        if (!out) {
+            throw std::runtime_error("Cannot truncate file: " + path);
+        }
+#endif
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing BinaryIO class..." << std::endl;
+        
+        std::ostringstream out;
+        write(out, 42);
+        write(out, 0.1);
+        write<long long>(out, -7);
+        std::istringstream in(out.str());
+        int i = read<int>(in);
+        double d = read<double>(in);
+        long long l = read<long long>(in);
+        std::cout << "Round trip: " << i << ", " << (d == 0.1 ? "exact" : "inexact") << ", " << l
+                  << " (expected: 42, exact, -7)" << std::endl;
+        try {
+            read<int>(in);
+            std::cout << "ERROR: Should have thrown exception for reading past the end" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Correctly caught runtime error: " << e.what() << std::endl;
+        }
+        
+        std::string path = "binaryio_test.bin";
+        replaceFile(path, "first");
+        replaceFile(path, "second");
+        std::string bytes;
+        bool found = readFile(path, bytes);
+        std::cout << "Replaced file holds: " << (found ? bytes : "(missing)") << " (expected: second)" << std::endl;
+        std::ifstream temp(path + ".tmp");
+        std::cout << "Temporary left behind: " << (temp ? "true" : "false") << " (expected: false)" << std::endl;
+        truncateFile(path, 3);
+        readFile(path, bytes);
+        std::cout << "Truncated file holds: " << bytes << ", size " << fileSize(path) << " (expected: sec, size 3)" << std::endl;
+        std::remove(path.c_str());
+        std::cout << "Missing file reads: " << (readFile(path, bytes) ? "true" : "false") << " (expected: false)" << std::endl;
+        
+        std::cout << "BinaryIO tests completed." << std::endl;
+    }
+};
+
+// A whole file mapped read-only, so large inputs are read in place from the
+// page cache; read into memory instead where there is no mmap
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::string copy;
+
+public:
+    explicit MappedFile(const std::string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat file: " + path);
+        }
+        length = size_t(info.st_size);
+        if (length > 0) {
+            void* map = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map file: " + path);
+            }
+            bytes = static_cast<const char*>(map);
+            mapped = true;
+        }
+        ::close(fd);
+#else
+        if (!BinaryIO::readFile(path, copy)) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+        bytes = copy.data();
+        length = copy.size();
+#endif
+    }
+    
+    ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped) ::munmap(const_cast<char*>(bytes), length);
+#endif
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    const char* data() const {
+        return bytes;
+    }
+    
+    size_t size() const {
+        return length;
+    }
+};
@@ -0,0 +1,218 @@
+#pragma once
+#include "FastRandom.hpp"
+#include "WorkerPool.hpp"
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+// bootstrap confidence intervals for the mean of a sample
+struct BootstrapInterval {
+    double estimate;          // sample mean
+    double percentileLow;     // percentile method
+    double percentileHigh;
+    double bcaLow;            // bias-corrected and accelerated (BCa)
+    double bcaHigh;
+    int replicates;
+};
+
+// Resamples with replacement in parallel. Replicate r always draws from its
+// own counter-seeded xoshiro256** stream, so the intervals do not depend on
+// the number of threads; each thread fills its own slice of replicate means.
+// Thresholds take few distinct values (k / n^2), so when the sample is
+// mostly ties a replicate is drawn as a multinomial histogram over the
+// distinct values - one binomial per value instead of one draw per sample.
+class Bootstrap {
+private:
+    static double normalCdf(double x) {
+        return 0.5 * std::erfc(-x / std::sqrt(2.0));
+    }
+    
+    // Inverse normal CDF (Acklam's rational approximation, one Newton step)
+    static double normalQuantile(double p) {
+        static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                   1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+        static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                   6.680131188771972e+01, -1.328068155288572e+01};
+        static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                   -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+        static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                   3.754408661907416e+00};
+        const double low = 0.02425;
+        
+        double x;
+        if (p < low) {
+            double q = std::sqrt(-2 * std::log(p));
+            x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+                ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+        } else if (p <= 1 - low) {
+            double q = p - 0.5;
+            double r = q * q;
+            x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+                (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+        } else {
+            double q = std::sqrt(-2 * std::log(1 - p));
+            x = -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+                ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+        }
+        
+        double e = normalCdf(x) - p;
+        double u = e * std::sqrt(2 * M_PI) * std::exp(x * x / 2);
+        return x - u / (1 + x * u / 2);
+    }
+    
+    // value at fraction p of the sorted replicate means
+    static double percentile(const std::vector<double>& sorted, double p) {
+        double position = p * (sorted.size() - 1);
+        size_t below = size_t(position);
+        if (below + 1 >= sorted.size()) return sorted.back();
+        double weight = position - below;
+        return sorted[below] * (1 - weight) + sorted[below + 1] * weight;
+    }
+
+public:
+    // percentile and BCa intervals for the mean of samples
+    static BootstrapInterval meanInterval(const std::vector<double>& samples, int replicates = 1000,
+                                          double confidence = 0.95, int threads = 1,
+                                          uint64_t seed = std::random_device{}()) {
+        if (samples.size() < 2) {
+            throw std::invalid_argument("Bootstrap needs at least two samples");
+        }
+        if (replicates < 2) {
+            throw std::invalid_argument("Bootstrap needs at least two replicates");
+        }
+        if (confidence <= 0.0 || confidence >= 1.0) {
+            throw std::invalid_argument("Confidence level must be in (0, 1)");
+        }
+        
+        const uint32_t size = uint32_t(samples.size());
+        double sum = 0.0;
+        for (double x : samples) sum += x;
+        const double estimate = sum / size;
+        
+        // Histogram of distinct values
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<double> values;
+        std::vector<long long> counts;
+        for (double x : sorted) {
+            if (values.empty() || x != values.back()) {
+                values.push_back(x);
+                counts.push_back(0);
+            }
+            counts.back()++;
+        }
+        bool multinomial = values.size() * 8 <= sorted.size();
+        
+        // Replicate means, each thread filling a contiguous slice
+        std::vector<double> means(replicates);
+        WorkerPool pool(threads, false);
+        pool.run([&](int worker) {
+            int first = int((long long)replicates * worker / threads);
+            int last = int((long long)replicates * (worker + 1) / threads);
+            std::vector<long long> histogram(values.size());   // this thread's partial histogram
+            
+            for (int r = first; r < last; r++) {
+                Xoshiro256 gen(SplitMix64(seed ^ (0x9e3779b97f4a7c15ULL * (r + 1))).next());
+                double total = 0.0;
+                if (multinomial) {
+                    // Conditional binomials: value v takes its share of what is left
+                    long long remaining = size;
+                    long long remainingWeight = size;
+                    for (size_t v = 0; v < values.size(); v++) {
+                        if (remaining == 0 || v + 1 == values.size()) {
+                            histogram[v] = remaining;
+                        } else {
+                            double p = std::min(1.0, double(counts[v]) / remainingWeight);
+                            std::binomial_distribution<long long> draw(remaining, p);
+                            histogram[v] = draw(gen);
+                        }
+                        remaining -= histogram[v];
+                        remainingWeight -= counts[v];
+                        total += histogram[v] * values[v];
+                    }
+                } else {
+                    for (uint32_t i = 0; i < size; i++) {
+                        total += samples[gen.bounded(size)];
+                    }
+                }
+                means[r] = total / size;
+            }
+        });
+        std::sort(means.begin(), means.end());
+        
+        double alpha = (1.0 - confidence) / 2.0;
+        BootstrapInterval result;
+        result.estimate = estimate;
+        result.replicates = replicates;
+        result.percentileLow = percentile(means, alpha);
+        result.percentileHigh = percentile(means, 1.0 - alpha);
+        
+        // Bias correction: where the estimate falls among the replicates
+        double below = double(std::lower_bound(means.begin(), means.end(), estimate) - means.begin());
+        double ties = double(std::upper_bound(means.begin(), means.end(), estimate) - means.begin()) - below;
+        double fraction = (below + ties / 2.0) / replicates;
+        fraction = std::min(std::max(fraction, 0.5 / replicates), 1.0 - 0.5 / replicates);
+        double z0 = normalQuantile(fraction);
+        
+        // Acceleration from the jackknife, closed form for the mean
+        double sumSquares = 0.0, sumCubes = 0.0;
+        for (double x : samples) {
+            double d = x - estimate;
+            sumSquares += d * d;
+            sumCubes += d * d * d;
+        }
+        double acceleration = sumSquares > 0 ? sumCubes / (6.0 * std::pow(sumSquares, 1.5)) : 0.0;
+        
+        auto adjusted = [&](double p) {
+            double z = normalQuantile(p);
+            return normalCdf(z0 + (z0 + z) / (1.0 - acceleration * (z0 + z)));
+        };
+        result.bcaLow = percentile(means, adjusted(alpha));
+        result.bcaHigh = percentile(means, adjusted(1.0 - alpha));
+        return result;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing Bootstrap class..." << std::endl;
+        
+        std::cout << "normalQuantile(0.975): " << normalQuantile(0.975) << " (expected: 1.95996)" << std::endl;
+        
+        // 2000 draws from N(10, 1): both intervals should be about 10 +/- 0.044
+        Xoshiro256 gen(7);
+        std::normal_distribution<double> normal(10.0, 1.0);
+        std::vector<double> samples(2000);
+        for (double& x : samples) x = normal(gen);
+        
+        BootstrapInterval one = meanInterval(samples, 1000, 0.95, 1, 99);
+        BootstrapInterval four = meanInterval(samples, 1000, 0.95, 4, 99);
+        double width = one.percentileHigh - one.percentileLow;
+        std::cout << "Percentile width near 2*1.96/sqrt(2000): " << (std::fabs(width - 0.0877) < 0.01 ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "BCa interval contains estimate: " << (one.bcaLow < one.estimate && one.estimate < one.bcaHigh ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Same seed, 1 vs 4 threads identical: "
+                  << (one.bcaLow == four.bcaLow && one.percentileHigh == four.percentileHigh ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // Heavily tied sample (three values, like n=2 thresholds) takes the multinomial path
+        std::vector<double> tied(30000);
+        for (size_t i = 0; i < tied.size(); i++) {
+            tied[i] = 0.5 + 0.25 * (i % 3);
+        }
+        BootstrapInterval ties = meanInterval(tied, 1000, 0.95, 2, 5);
+        double tiedHalfWidth = 1.96 * std::sqrt(1.0 / 24.0 / tied.size());
+        std::cout << "Tied percentile width near normal: "
+                  << (std::fabs((ties.percentileHigh - ties.percentileLow) / 2 - tiedHalfWidth) < 0.2 * tiedHalfWidth ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        try {
+            meanInterval(std::vector<double>{1.0}, 100);
+            std::cout << "ERROR: Should have thrown exception for a single sample" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "Bootstrap tests completed." << std::endl;
+    }
+};
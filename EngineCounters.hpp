@@ -0,0 +1,105 @@
+#pragma once
+#include <array>
+#include <iostream>
+#include <iomanip>
+
+// Engine instrumentation is compiled in only with -DPERCOLATION_COUNTERS;
+// otherwise PERCOLATION_COUNT(...) expands to nothing and the engines carry
+// no counter members at all.
+#ifdef PERCOLATION_COUNTERS
+#define PERCOLATION_COUNT(statement) statement
+#else
+#define PERCOLATION_COUNT(statement)
+#endif
+
+// What the union-find engines and the trial loop actually did
+struct EngineCounters {
+    static const int PATH_BUCKETS = 64;   // the last bucket holds every longer path
+    
+    std::array<long long, PATH_BUCKETS> pathLengths{};   // finds by number of links walked to the root
+    long long finds = 0;
+    long long unions = 0;                 // unionSites() calls
+    long long redundantUnions = 0;        // calls whose sites already shared a root
+    long long relabels = 0;               // quick-find id entries rewritten
+    long long rejectedDraws = 0;          // random sites drawn that were already open
+    
+    void recordFind(int length) {
+        finds++;
+        pathLengths[length < PATH_BUCKETS ? length : PATH_BUCKETS - 1]++;
+    }
+    
+    void merge(const EngineCounters& other) {
+        for (int k = 0; k < PATH_BUCKETS; k++) {
+            pathLengths[k] += other.pathLengths[k];
+        }
+        finds += other.finds;
+        unions += other.unions;
+        redundantUnions += other.redundantUnions;
+        relabels += other.relabels;
+        rejectedDraws += other.rejectedDraws;
+    }
+    
+    double meanPathLength() const {
+        if (finds == 0) return 0.0;
+        double total = 0.0;
+        for (int k = 0; k < PATH_BUCKETS; k++) {
+            total += double(k) * pathLengths[k];
+        }
+        return total / finds;
+    }
+    
+    int maxPathLength() const {
+        for (int k = PATH_BUCKETS - 1; k > 0; k--) {
+            if (pathLengths[k] > 0) return k;
+        }
+        return 0;
+    }
+    
+    // totals divided over a trial set, then the non-empty path-length buckets
+    void print(std::ostream& out, long long trials) const {
+        std::ios::fmtflags flags = out.flags();
+        double t = trials > 0 ? double(trials) : 1.0;
+        out << std::fixed << std::setprecision(1);
+        out << "finds/trial      = " << finds / t << " (mean path " << std::setprecision(3) << meanPathLength()
+            << ", max " << maxPathLength() << ")\n";
+        out << std::setprecision(1);
+        out << "unions/trial     = " << unions / t << " (" << (unions > 0 ? 100.0 * redundantUnions / unions : 0.0)
+            << "% redundant)\n";
+        if (relabels > 0) {
+            out << "relabels/trial   = " << relabels / t << '\n';
+        }
+        out << "rejected draws   = " << rejectedDraws / t << " per trial\n";
+        out << "path lengths     =";
+        for (int k = 0; k < PATH_BUCKETS; k++) {
+            if (pathLengths[k] > 0) out << " " << k << ":" << pathLengths[k];
+        }
+        out << '\n';
+        out.flags(flags);
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing EngineCounters class..." << std::endl;
+        
+        EngineCounters a, b;
+        a.recordFind(0);
+        a.recordFind(2);
+        b.recordFind(1);
+        b.recordFind(1000);
+        b.unions = 3;
+        b.redundantUnions = 1;
+        a.merge(b);
+        std::cout << "Finds after merge: " << a.finds << " (expected: 4)" << std::endl;
+        std::cout << "Long path lands in last bucket: " << (a.pathLengths[PATH_BUCKETS - 1] == 1 ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Max path length: " << a.maxPathLength() << " (expected: " << PATH_BUCKETS - 1 << ")" << std::endl;
+        std::cout << "Unions after merge: " << a.unions << " (expected: 3)" << std::endl;
+
+#ifdef PERCOLATION_COUNTERS
+        std::cout << "Engine counters compiled in: true" << std::endl;
+#else
+        std::cout << "Engine counters compiled in: false (build with -DPERCOLATION_COUNTERS)" << std::endl;
+#endif
+        
+        std::cout << "EngineCounters tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+// SplitMix64 - used to expand a single 64-bit seed into generator state
+class SplitMix64 {
+private:
+    uint64_t state;
+
+public:
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+    
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+};
+
+// xoshiro256** - fast 64-bit generator, usable with <random> distributions
+class Xoshiro256 {
+private:
+    uint64_t s[4];
+    
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    using result_type = uint64_t;
+    
+    explicit Xoshiro256(uint64_t seed = 0) {
+        SplitMix64 sm(seed);
+        for (int i = 0; i < 4; i++) {
+            s[i] = sm.next();
+        }
+    }
+    
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<uint64_t>::max(); }
+    
+    result_type operator()() {
+        const uint64_t result = rotl(s[1] * 5, 7) * 9;
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+    
+    // uniform integer in [0, range) using multiply-shift (Lemire), no division
+    uint32_t bounded(uint32_t range) {
+        uint64_t m = (uint64_t)(uint32_t)((*this)() >> 32) * range;
+        uint32_t low = (uint32_t)m;
+        if (low < range) {
+            uint32_t threshold = (uint32_t)(-range) % range;
+            while (low < threshold) {
+                m = (uint64_t)(uint32_t)((*this)() >> 32) * range;
+                low = (uint32_t)m;
+            }
+        }
+        return (uint32_t)(m >> 32);
+    }
+};
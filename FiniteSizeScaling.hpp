@@ -0,0 +1,266 @@
+#pragma once
+#include "PercolationStat.hpp"
+#include "StatsAccumulator.hpp"
+#include "Stopwatch.hpp"
+#include <vector>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+// measured threshold at one grid size
+struct ScalingPoint {
+    int n;
+    long long trials;
+    double mean;
+    double stddev;
+    double secondsPerTrial;
+};
+
+// p_c(n) = pc + amplitude * n^(-1/nu), fitted by weighted least squares
+struct ScalingFit {
+    double pc;
+    double pcError;                   // one standard error
+    double amplitude;
+    double amplitudeError;
+    double chiSquaredPerDof;
+    double nu;
+};
+
+// Finite-size-scaling driver: measures the mean threshold on a geometric
+// sweep of grid sizes and extrapolates to the infinite lattice. After a
+// pilot at every size, the remaining time budget goes, a slice at a time,
+// to whichever size most reduces the variance of the extrapolated p_c per
+// second of work - not evenly across sizes.
+class FiniteSizeScaling {
+private:
+    std::vector<int> sizes;
+    double nu;
+    StatsOptions options;
+    std::vector<StatsAccumulator> tallies;      // threshold samples per size
+    std::vector<double> seconds;                // time spent per size
+    std::vector<uint64_t> batches;              // PercolationStats runs per size so far
+    
+    // Run trials at size i, in batches that fit an int. With a fixed seed
+    // each batch gets a seed of its own from (seed, size, batch): reusing
+    // the seed would repeat earlier trials and understate the error
+    void measure(size_t i, long long trials) {
+        while (trials > 0) {
+            int batch = int(std::min<long long>(trials, INT_MAX));
+            StatsOptions batchOptions = options;
+            if (options.seed != 0) {
+                SplitMix64 mix(options.seed ^ (uint64_t(i) << 40) ^ batches[i]);
+                batchOptions.seed = mix.next() | 1;
+            }
+            batches[i]++;
+            Stopwatch sw;
+            PercolationStats stats(sizes[i], batch, batchOptions);
+            seconds[i] += sw.elapsedTime();
+            tallies[i].merge(stats.accumulator());
+            trials -= batch;
+        }
+    }
+    
+    // Variance of the fitted pc for given trial counts
+    static double pcVariance(const std::vector<ScalingPoint>& points, const std::vector<double>& trials, double nu) {
+        double s = 0, sx = 0, sxx = 0;
+        for (size_t i = 0; i < points.size(); i++) {
+            double x = std::pow(points[i].n, -1.0 / nu);
+            double w = trials[i] / (points[i].stddev * points[i].stddev);
+            s += w;
+            sx += w * x;
+            sxx += w * x * x;
+        }
+        return sxx / (s * sxx - sx * sx);
+    }
+
+public:
+    // sweep nMin, nMin*ratio, ... up to nMax; nu = 4/3 for 2D percolation
+    FiniteSizeScaling(int nMin, int nMax, double ratio = 2.0, double nu = 4.0 / 3.0,
+                      const StatsOptions& options = StatsOptions())
+        : nu(nu), options(options) {
+        if (nMin < 2 || nMax < nMin) {
+            throw std::invalid_argument("Need 2 <= nMin <= nMax");
+        }
+        if (ratio <= 1.0) {
+            throw std::invalid_argument("Size ratio must be greater than 1");
+        }
+        
+        for (double n = nMin; n <= nMax + 0.5; n *= ratio) {
+            int size = int(std::lround(n));
+            if (sizes.empty() || size != sizes.back()) sizes.push_back(size);
+        }
+        if (sizes.size() < 3) {
+            throw std::invalid_argument("Sweep needs at least three grid sizes");
+        }
+        tallies.resize(sizes.size());
+        seconds.assign(sizes.size(), 0.0);
+        batches.assign(sizes.size(), 0);
+    }
+    
+    // Greedy allocation of extra trials: repeatedly give one budget slice to
+    // the size whose variance reduction per second is largest
+    static std::vector<long long> allocate(const std::vector<ScalingPoint>& points, double budgetSeconds,
+                                           double nu, int slices = 100) {
+        std::vector<double> trials;
+        for (const auto& point : points) trials.push_back(double(point.trials));
+        
+        std::vector<double> extra(points.size(), 0.0);
+        double slice = budgetSeconds / slices;
+        for (int step = 0; step < slices; step++) {
+            double current = pcVariance(points, trials, nu);
+            size_t best = 0;
+            double bestGain = -1.0;
+            for (size_t i = 0; i < points.size(); i++) {
+                double added = slice / points[i].secondsPerTrial;
+                trials[i] += added;
+                double gain = current - pcVariance(points, trials, nu);
+                trials[i] -= added;
+                if (gain > bestGain) {
+                    bestGain = gain;
+                    best = i;
+                }
+            }
+            double added = slice / points[best].secondsPerTrial;
+            trials[best] += added;
+            extra[best] += added;
+        }
+        
+        std::vector<long long> result;
+        for (double e : extra) result.push_back((long long)e);
+        return result;
+    }
+    
+    // weighted least-squares fit of mean = pc + amplitude * n^(-1/nu)
+    static ScalingFit fitPoints(const std::vector<ScalingPoint>& points, double nu) {
+        double s = 0, sx = 0, sxx = 0, sy = 0, sxy = 0;
+        for (const auto& point : points) {
+            double x = std::pow(point.n, -1.0 / nu);
+            double w = point.trials / (point.stddev * point.stddev);
+            s += w;
+            sx += w * x;
+            sxx += w * x * x;
+            sy += w * point.mean;
+            sxy += w * x * point.mean;
+        }
+        
+        double det = s * sxx - sx * sx;
+        ScalingFit fit;
+        fit.nu = nu;
+        fit.pc = (sxx * sy - sx * sxy) / det;
+        fit.amplitude = (s * sxy - sx * sy) / det;
+        fit.pcError = std::sqrt(sxx / det);
+        fit.amplitudeError = std::sqrt(s / det);
+        
+        double chiSquared = 0.0;
+        for (const auto& point : points) {
+            double x = std::pow(point.n, -1.0 / nu);
+            double residual = point.mean - fit.pc - fit.amplitude * x;
+            chiSquared += residual * residual * point.trials / (point.stddev * point.stddev);
+        }
+        fit.chiSquaredPerDof = points.size() > 2 ? chiSquared / (points.size() - 2) : 0.0;
+        return fit;
+    }
+    
+    // pilot every size, then spend what is left of the budget where it counts
+    void run(double budgetSeconds, int pilotTrials = 50) {
+        if (budgetSeconds <= 0) {
+            throw std::invalid_argument("Time budget must be positive");
+        }
+        if (pilotTrials < 2) {
+            throw std::invalid_argument("Pilot needs at least two trials per size");
+        }
+        
+        Stopwatch sw;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            measure(i, pilotTrials);
+        }
+        
+        double remaining = budgetSeconds - sw.elapsedTime();
+        if (remaining <= 0) return;
+        
+        std::vector<long long> extra = allocate(points(), remaining, nu);
+        for (size_t i = 0; i < sizes.size(); i++) {
+            measure(i, extra[i]);
+        }
+    }
+    
+    std::vector<ScalingPoint> points() const {
+        std::vector<ScalingPoint> result;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            long long trials = tallies[i].size();
+            result.push_back(ScalingPoint{sizes[i], trials, tallies[i].mean(), tallies[i].stddev(),
+                                          trials > 0 ? seconds[i] / trials : 0.0});
+        }
+        return result;
+    }
+    
+    ScalingFit fit() const {
+        return fitPoints(points(), nu);
+    }
+    
+    // per-size table followed by the extrapolation
+    void print(std::ostream& out) const {
+        out << std::setw(8) << "n" << std::setw(10) << "trials" << std::setw(12) << "mean"
+            << std::setw(12) << "stddev" << std::setw(14) << "s/trial" << std::endl;
+        for (const auto& point : points()) {
+            out << std::setw(8) << point.n << std::setw(10) << point.trials
+                << std::fixed << std::setprecision(6)
+                << std::setw(12) << point.mean << std::setw(12) << point.stddev
+                << std::setw(14) << point.secondsPerTrial << std::endl;
+        }
+        
+        ScalingFit result = fit();
+        out << "p_c(inf)         = " << result.pc << " +/- " << result.pcError << std::endl;
+        out << "amplitude        = " << result.amplitude << " +/- " << result.amplitudeError << std::endl;
+        out << "chi^2 / dof      = " << result.chiSquaredPerDof << " (nu = " << result.nu << ")" << std::endl;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing FiniteSizeScaling class..." << std::endl;
+        
+        // Exact synthetic data: the fit must recover pc and amplitude
+        std::vector<ScalingPoint> synthetic;
+        for (int n : {16, 32, 64, 128}) {
+            double mean = 0.59 + 0.1 * std::pow(n, -0.75);
+            synthetic.push_back(ScalingPoint{n, 1000, mean, 0.05, 1e-4 * n * n});
+        }
+        ScalingFit exact = fitPoints(synthetic, 4.0 / 3.0);
+        std::cout << "Recovered pc: " << std::fixed << std::setprecision(4) << exact.pc << " (expected: 0.5900)" << std::endl;
+        std::cout << "Recovered amplitude: " << exact.amplitude << " (expected: 0.1000)" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+        
+        // Extra trials should not be spread evenly
+        std::vector<long long> extra = allocate(synthetic, 10.0, 4.0 / 3.0);
+        std::cout << "Allocation is uneven: " << (extra.front() != extra.back() ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // A tiny real sweep should land near the known threshold
+        FiniteSizeScaling sweep(8, 32);
+        sweep.run(0.2, 20);
+        double pc = sweep.fit().pc;
+        std::cout << "Extrapolated pc in [0.5, 0.7]: " << (pc > 0.5 && pc < 0.7 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // A seeded sweep's second pilot must draw new trials, not repeat the first
+        StatsOptions seeded;
+        seeded.seed = 42;
+        FiniteSizeScaling repeat(8, 32, 2.0, 4.0 / 3.0, seeded);
+        repeat.run(1e-9, 20);
+        double firstMean = repeat.points()[0].mean;
+        repeat.run(1e-9, 20);
+        std::cout << "Second seeded pilot adds new trials: " << (repeat.points()[0].trials == 40 && repeat.points()[0].mean != firstMean ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        try {
+            FiniteSizeScaling invalid(16, 20);
+            std::cout << "ERROR: Should have thrown exception for a sweep with too few sizes" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "FiniteSizeScaling tests completed." << std::endl;
+    }
+};
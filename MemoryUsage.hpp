@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Resident memory of this process, for matching grid sizes to machine memory
+class MemoryUsage {
+public:
+    // high-water mark of resident memory since the process started, or since
+    // the last resetPeak() where that worked (0 if unknown)
+    static size_t peakRssBytes() {
+#if defined(__linux__)
+        // VmHWM honours resetPeak(); getrusage's maximum never goes down
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) return size_t(std::stoull(line.substr(6))) * 1024;
+        }
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+        return size_t(usage.ru_maxrss);          // bytes on macOS
+#else
+        return size_t(usage.ru_maxrss) * 1024;   // kilobytes on Linux
+#endif
+#else
+        return 0;
+#endif
+    }
+    
+    // Restart the high-water mark from the current resident size, so a
+    // run's peak is not the unit tests' (Linux 4.0+); false if unsupported
+    static bool resetPeak() {
+#if defined(__linux__)
+        std::ofstream clear("/proc/self/clear_refs");
+        clear << "5";
+        clear.flush();
+        return bool(clear);
+#else
+        return false;
+#endif
+    }
+    
+    // resident memory right now (Linux /proc; 0 elsewhere)
+    static size_t currentRssBytes() {
+#if defined(__linux__)
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        if (statm >> pages >> resident) return resident * size_t(sysconf(_SC_PAGESIZE));
+#endif
+        return 0;
+    }
+    
+    // "512 B", "13.1 MB", "2.00 GB"
+    static std::string format(double bytes) {
+        const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+        int unit = 0;
+        while (bytes >= 1024.0 && unit < 4) {
+            bytes /= 1024.0;
+            unit++;
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.2f %s", bytes, units[unit]);
+        return text;
+    }
+    
+    // Largest n whose footprint bytesFor(n) fits in budget, up to maxN
+    template <typename BytesFor>
+    static int largestGrid(BytesFor bytesFor, double budget, int maxN) {
+        int low = 0, high = maxN;
+        while (low < high) {
+            int mid = low + (high - low + 1) / 2;
+            if (double(bytesFor(mid)) <= budget) low = mid;
+            else high = mid - 1;
+        }
+        return low;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing MemoryUsage class..." << std::endl;
+        
+        size_t before = peakRssBytes();
+        {
+            std::vector<char> block(64 << 20, 1);   // touched, so resident
+            volatile char keep = block[block.size() / 2];
+            (void)keep;
+        }
+        size_t after = peakRssBytes();
+        if (before == 0) {
+            std::cout << "Peak RSS unavailable on this platform" << std::endl;
+        } else {
+            std::cout << "Peak RSS covers a 64 MB block: " << (after >= 64u << 20 ? "true" : "false") << " (expected: true)" << std::endl;
+        }
+        std::cout << "Peak RSS never below current: " << (peakRssBytes() + 4096 >= currentRssBytes() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        if (resetPeak()) {
+            std::cout << "Peak RSS after reset below the freed block: " << (peakRssBytes() < after - (32u << 20) ? "true" : "false")
+                      << " (expected: true)" << std::endl;
+        }
+        std::cout << "format(1536): " << format(1536) << " (expected: 1.50 KB)" << std::endl;
+        std::cout << "Largest n with n^2 <= 1e6: " << largestGrid([](int n) { return double(n) * n; }, 1e6, 1 << 20)
+                  << " (expected: 1000)" << std::endl;
+        
+        std::cout << "MemoryUsage tests completed." << std::endl;
+    }
+};
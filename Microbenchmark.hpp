@@ -0,0 +1,249 @@
+#pragma once
+#include "Percolation.hpp"
+#include "PercolationQuickFind.hpp"
+#include "PercolationBitSliced.hpp"
+#include "BenchmarkRunner.hpp"
+#include "FastRandom.hpp"
+#include "Stopwatch.hpp"
+#include <vector>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+// cost of one primitive on one engine at one grid state
+struct MicroResult {
+    std::string engine;
+    int n;
+    double fill;               // fraction of sites open before the timed batch
+    std::string op;
+    double nsPerOp;            // median over repetitions
+};
+
+// Per-operation cost of the union-find primitives and of open(), isFull()
+// and percolates() for every engine, on controlled inputs: a fixed site
+// permutation, grids pre-filled to a given fraction of it, and fixed query
+// lists. Each repetition rebuilds the grid outside the timed region, so a
+// batch always starts from the same state. Engines make this class a friend
+// so find() and unionSites() can be timed without widening their interfaces.
+class Microbenchmark {
+private:
+    int repetitions;
+    int batch;                 // operations per timed batch
+    int quickFindMaxN;         // quick-find rebuilds are O(n^4); skip larger grids
+    
+    // Times one batch of ops; returns ns per op
+    template <typename Op>
+    static double timeBatch(int count, Op op) {
+        Stopwatch sw;
+        for (int i = 0; i < count; i++) op(i);
+        return sw.elapsedTime() * 1e9 / count;
+    }
+    
+    // Fixed inputs for one (n, fill) point
+    struct Inputs {
+        std::vector<int> order;        // site permutation
+        int prefilled;                 // order[0, prefilled) open before timing
+        std::vector<int> openSites;    // query sites drawn from the open ones
+        std::vector<int> anySites;     // query sites drawn from the whole grid
+        std::vector<int> pairs;        // open sites to union, two per op, each pair in different clusters
+    };
+    
+    // Scratch union-find to pick union pairs that really merge clusters
+    static int root(std::vector<int>& parent, int x) {
+        while (parent[x] != x) x = parent[x] = parent[parent[x]];
+        return x;
+    }
+    
+    Inputs makeInputs(int n, double fill) const {
+        Inputs in;
+        int sites = n * n;
+        in.order.resize(sites);
+        std::iota(in.order.begin(), in.order.end(), 0);
+        Xoshiro256 gen(12345 + n);
+        std::shuffle(in.order.begin(), in.order.end(), gen);
+        
+        // At least one site open, and at least one left to open
+        in.prefilled = std::max(1, std::min(int(fill * sites), sites - 1));
+        for (int i = 0; i < batch; i++) {
+            in.openSites.push_back(in.order[gen.bounded(uint32_t(in.prefilled))]);
+            in.anySites.push_back(int(gen.bounded(uint32_t(sites))));
+        }
+        
+        // Clusters of the prefilled grid, then random pairs that join two of them
+        std::vector<int> parent(sites);
+        std::vector<bool> open(sites, false);
+        std::iota(parent.begin(), parent.end(), 0);
+        for (int i = 0; i < in.prefilled; i++) {
+            int site = in.order[i];
+            open[site] = true;
+            int row = site / n, col = site % n;
+            if (row > 0 && open[site - n]) parent[root(parent, site)] = root(parent, site - n);
+            if (row < n - 1 && open[site + n]) parent[root(parent, site)] = root(parent, site + n);
+            if (col > 0 && open[site - 1]) parent[root(parent, site)] = root(parent, site - 1);
+            if (col < n - 1 && open[site + 1]) parent[root(parent, site)] = root(parent, site + 1);
+        }
+        for (int attempt = 0; attempt < 64 * batch && int(in.pairs.size()) < 2 * batch; attempt++) {
+            int a = in.order[gen.bounded(uint32_t(in.prefilled))];
+            int b = in.order[gen.bounded(uint32_t(in.prefilled))];
+            if (root(parent, a) == root(parent, b)) continue;
+            parent[root(parent, a)] = root(parent, b);
+            in.pairs.push_back(a);
+            in.pairs.push_back(b);
+        }
+        return in;
+    }
+    
+    template <typename Engine>
+    static void prefill(Engine& engine, int n, const Inputs& in) {
+        for (int i = 0; i < in.prefilled; i++) {
+            engine.open(in.order[i] / n, in.order[i] % n);
+        }
+    }
+    
+    // find, unionSites, open, isFull and percolates on a union-find engine
+    template <typename Engine>
+    void measureUnionFind(const std::string& name, int n, double fill, std::vector<MicroResult>& out) const {
+        Inputs in = makeInputs(n, fill);
+        int openBatch = std::min(batch, n * n - in.prefilled);
+        int unionBatch = std::max(1, int(in.pairs.size()) / 2);
+        std::vector<double> find, unite, open, full, percolates;
+        long long sink = 0;
+        
+        for (int r = 0; r < repetitions; r++) {
+            Engine engine(n);
+            prefill(engine, n, in);
+            find.push_back(timeBatch(batch, [&](int i) { sink += engine.find(in.openSites[i]); }));
+            full.push_back(timeBatch(batch, [&](int i) { sink += engine.isFull(in.anySites[i] / n, in.anySites[i] % n); }));
+            percolates.push_back(timeBatch(batch, [&](int) { sink += engine.percolates(); }));
+            open.push_back(timeBatch(openBatch, [&](int i) {
+                int site = in.order[in.prefilled + i];
+                engine.open(site / n, site % n);
+            }));
+            
+            // Arbitrary unions distort the grid, so they get a fresh one
+            Engine unions(n);
+            prefill(unions, n, in);
+            if (!in.pairs.empty()) {
+                unite.push_back(timeBatch(unionBatch, [&](int i) { unions.unionSites(in.pairs[2 * i], in.pairs[2 * i + 1]); }));
+                sink += unions.find(in.pairs[0]);
+            }
+        }
+        volatile long long keep = sink;   // keep the results live
+        (void)keep;
+        
+        out.push_back(MicroResult{name, n, fill, "find", BenchmarkRunner::median(find)});
+        if (!unite.empty()) {
+            out.push_back(MicroResult{name, n, fill, "unionSites", BenchmarkRunner::median(unite)});
+        }
+        out.push_back(MicroResult{name, n, fill, "open", BenchmarkRunner::median(open)});
+        out.push_back(MicroResult{name, n, fill, "isFull", BenchmarkRunner::median(full)});
+        out.push_back(MicroResult{name, n, fill, "percolates", BenchmarkRunner::median(percolates)});
+    }
+    
+    // open, isFull and percolates on the bit-sliced engine; one call
+    // covers a site in one lane (open, isFull) or all 64 trials (percolates)
+    void measureBitSliced(int n, double fill, std::vector<MicroResult>& out) const {
+        Inputs in = makeInputs(n, fill);
+        int openBatch = std::min(batch, n * n - in.prefilled);
+        int floods = std::max(1, std::min(batch, (1 << 22) / (n * n)));
+        std::vector<double> open, full, percolates;
+        long long sink = 0;
+        
+        for (int r = 0; r < repetitions; r++) {
+            PercolationBitSliced engine(n, 1);
+            for (int i = 0; i < in.prefilled; i++) {
+                engine.open(in.order[i] / n, in.order[i] % n, i % PercolationBitSliced::TRIALS_PER_WORD);
+            }
+            percolates.push_back(timeBatch(floods, [&](int) { sink += __builtin_popcountll(engine.percolates()); }));
+            full.push_back(timeBatch(batch, [&](int i) {
+                sink += engine.isFull(in.anySites[i] / n, in.anySites[i] % n, i % PercolationBitSliced::TRIALS_PER_WORD);
+            }));
+            open.push_back(timeBatch(openBatch, [&](int i) {
+                int site = in.order[in.prefilled + i];
+                engine.open(site / n, site % n, i % PercolationBitSliced::TRIALS_PER_WORD);
+            }));
+        }
+        volatile long long keep = sink;
+        (void)keep;
+        
+        out.push_back(MicroResult{"Bit-sliced", n, fill, "open", BenchmarkRunner::median(open)});
+        out.push_back(MicroResult{"Bit-sliced", n, fill, "isFull", BenchmarkRunner::median(full)});
+        out.push_back(MicroResult{"Bit-sliced", n, fill, "percolates", BenchmarkRunner::median(percolates)});
+    }
+
+public:
+    explicit Microbenchmark(int repetitions = 7, int batch = 4096, int quickFindMaxN = 128)
+        : repetitions(repetitions), batch(batch), quickFindMaxN(quickFindMaxN) {
+        if (repetitions <= 0 || batch <= 0) {
+            throw std::invalid_argument("Repetitions and batch size must be positive");
+        }
+    }
+    
+    // every engine and primitive over the given sizes and fill fractions
+    std::vector<MicroResult> run(const std::vector<int>& sizes, const std::vector<double>& fills) const {
+        std::vector<MicroResult> results;
+        for (int n : sizes) {
+            if (n < 2) {
+                throw std::invalid_argument("Grid size must be at least 2");
+            }
+            for (double fill : fills) {
+                if (fill < 0.0 || fill >= 1.0) {
+                    throw std::invalid_argument("Fill fraction must be in [0, 1)");
+                }
+                measureUnionFind<Percolation>("Weighted QU", n, fill, results);
+                if (n <= quickFindMaxN) {
+                    measureUnionFind<PercolationQuickFind>("Quick-Find", n, fill, results);
+                }
+                measureBitSliced(n, fill, results);
+            }
+        }
+        return results;
+    }
+    
+    // one row per (engine, n, fill, op)
+    static void print(std::ostream& out, const std::vector<MicroResult>& results) {
+        out << std::left << std::setw(14) << "engine" << std::right << std::setw(8) << "n" << std::setw(8) << "fill"
+            << "  " << std::left << std::setw(12) << "op" << std::right << std::setw(14) << "ns/op" << std::endl;
+        out << std::string(56, '-') << std::endl;
+        for (const auto& result : results) {
+            out << std::left << std::setw(14) << result.engine << std::right << std::setw(8) << result.n
+                << std::fixed << std::setprecision(2) << std::setw(8) << result.fill
+                << "  " << std::left << std::setw(12) << result.op << std::right
+                << std::setprecision(2) << std::setw(14) << result.nsPerOp << std::endl;
+        }
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing Microbenchmark class..." << std::endl;
+        
+        Microbenchmark quick(3, 256);
+        std::vector<MicroResult> results = quick.run({16}, {0.5});
+        std::cout << "Results for 3 engines: " << results.size() << " (expected: 13)" << std::endl;
+        
+        bool positive = true;
+        for (const auto& result : results) positive &= result.nsPerOp > 0;
+        std::cout << "Every ns/op positive: " << (positive ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // Quick-find unions relabel the whole array; weighted quick-union does not
+        double qfUnion = 0, wquUnion = 0;
+        for (const auto& result : quick.run({64}, {0.5})) {
+            if (result.op != "unionSites") continue;
+            (result.engine == "Quick-Find" ? qfUnion : wquUnion) = result.nsPerOp;
+        }
+        std::cout << "Quick-Find union slower than weighted QU at n=64: " << (qfUnion > wquUnion ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        try {
+            quick.run({16}, {1.0});
+            std::cout << "ERROR: Should have thrown exception for a full grid" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "Microbenchmark tests completed." << std::endl;
+    }
+};
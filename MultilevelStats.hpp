@@ -0,0 +1,326 @@
+#pragma once
+#include "Percolation.hpp"
+#include "StatsAccumulator.hpp"
+#include "FastRandom.hpp"
+#include "WorkerPool.hpp"
+#include "Stopwatch.hpp"
+#include <vector>
+#include <cmath>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+// one level of the multilevel estimator
+struct LevelReport {
+    int n;                     // fine grid size at this level
+    bool base;                 // plain thresholds rather than corrections
+    long long samples;
+    double mean;               // mean threshold (base level) or mean correction
+    double variance;
+    double secondsPerSample;
+};
+
+// Multilevel Monte Carlo estimate of the mean threshold at grid size n.
+// The base level samples plain thresholds on a coarse grid; each finer level
+// l samples the correction T(n_l) - T(n_l / 2) from one coupled draw: a
+// random site order on the n_l grid, with the coarse value taken as the
+// mean threshold of its four quadrants under the same order. Each quadrant
+// sees a uniform random order of its own sites, so the corrections
+// telescope exactly to the mean at n; sample counts follow N_l ~ sqrt(V_l / C_l).
+// The coupling is only moderately strong (correlation around 0.5), so the
+// base level is chosen from the pilot: the coarsest grid whose predicted
+// total cost is lowest, which is n itself (plain sampling) when no coarser
+// level pays for its corrections.
+class MultilevelStats {
+private:
+    int n;
+    int levelCount;
+    int threads;
+    int base;                                     // coarsest level in use
+    std::vector<StatsAccumulator> plain;          // plain thresholds per level
+    std::vector<double> plainSeconds;
+    std::vector<StatsAccumulator> corrections;    // coupled corrections per level (unused at level 0)
+    std::vector<double> correctionSeconds;
+    
+    // Draws coupled samples for one level on one thread
+    struct LevelSampler {
+        int n;
+        Percolation fine;
+        std::vector<Percolation> quadrants;
+        std::vector<int> order;
+        Xoshiro256 gen;
+        
+        LevelSampler(int n, bool coupled, uint64_t seed)
+            : n(n), fine(n), quadrants(coupled ? 4 : 0, Percolation(n / 2)), order(n * n), gen(seed) {
+            std::iota(order.begin(), order.end(), 0);
+        }
+        
+        // Opens sites in a fresh random order until the fine grid and every
+        // quadrant percolate. Returns the fine threshold minus the quadrant
+        // mean (just the fine threshold without quadrants).
+        double draw(double& fineThreshold) {
+            fine.reset();
+            for (auto& quadrant : quadrants) quadrant.reset();
+            
+            const uint32_t sites = uint32_t(n) * n;
+            const int half = n / 2;
+            fineThreshold = -1.0;
+            double coarse = 0.0;
+            int pending = int(quadrants.size());
+            
+            // Partial Fisher-Yates: only as much of the order as is used
+            for (uint32_t i = 0; fineThreshold < 0 || pending > 0; i++) {
+                std::swap(order[i], order[i + gen.bounded(sites - i)]);
+                int row = order[i] / n;
+                int col = order[i] % n;
+                
+                if (fineThreshold < 0) {
+                    fine.open(row, col);
+                    if (fine.percolates()) {
+                        fineThreshold = fine.numberOfOpenSites() / double(sites);
+                    }
+                }
+                if (!quadrants.empty()) {
+                    Percolation& quadrant = quadrants[(row >= half) * 2 + (col >= half)];
+                    if (!quadrant.percolates()) {
+                        quadrant.open(row % half, col % half);
+                        if (quadrant.percolates()) {
+                            coarse += quadrant.numberOfOpenSites() / (4.0 * half * half);
+                            pending--;
+                        }
+                    }
+                }
+            }
+            return quadrants.empty() ? fineThreshold : fineThreshold - coarse;
+        }
+    };
+    
+    int sizeOf(int level) const {
+        return n >> (levelCount - 1 - level);
+    }
+    
+    // Adds count plain (or coupled) samples to a level, split across the threads
+    void sample(int level, bool coupled, long long count) {
+        if (count <= 0) return;
+        
+        std::random_device rd;
+        std::vector<uint64_t> seeds(threads);
+        for (auto& seed : seeds) {
+            seed = ((uint64_t)rd() << 32) | rd();
+        }
+        
+        std::vector<StatsAccumulator> partials(threads);
+        Stopwatch sw;
+        WorkerPool pool(threads, false);
+        pool.run([&](int worker) {
+            long long first = count * worker / threads;
+            long long last = count * (worker + 1) / threads;
+            LevelSampler sampler(sizeOf(level), coupled, seeds[worker]);
+            for (long long s = first; s < last; s++) {
+                double fineThreshold;
+                partials[worker].add(sampler.draw(fineThreshold));
+            }
+        });
+        double cpu = sw.elapsedTime() * threads;
+        
+        StatsAccumulator& target = coupled ? corrections[level] : plain[level];
+        (coupled ? correctionSeconds[level] : plainSeconds[level]) += cpu;
+        for (const auto& partial : partials) {
+            target.merge(partial);
+        }
+    }
+    
+    // variance and CPU cost per sample of what a level contributes
+    // when the estimator's base level is `from`
+    const StatsAccumulator& termOf(int level, int from) const {
+        return level == from ? plain[level] : corrections[level];
+    }
+    
+    double termCost(int level, int from) const {
+        const StatsAccumulator& term = termOf(level, from);
+        double spent = level == from ? plainSeconds[level] : correctionSeconds[level];
+        return term.size() > 0 ? spent / term.size() : 0.0;
+    }
+    
+    // sum over the levels in use of sqrt(V_l * C_l)
+    double sumRootCost(int from) const {
+        double total = 0.0;
+        for (int l = from; l < levelCount; l++) {
+            total += std::sqrt(termOf(l, from).variance() * termCost(l, from));
+        }
+        return total;
+    }
+
+public:
+    // levels grids n / 2^(levels-1), ..., n / 2, n; n must divide evenly
+    MultilevelStats(int n, int levels, int threads = 1) : n(n), levelCount(levels), threads(threads) {
+        if (levels < 1) {
+            throw std::invalid_argument("Need at least one level");
+        }
+        if (threads <= 0) {
+            throw std::invalid_argument("Thread count must be positive");
+        }
+        if (n <= 0 || n % (1 << (levels - 1)) != 0 || (n >> (levels - 1)) < 2) {
+            throw std::invalid_argument("Grid size must be a multiple of 2^(levels-1) and leave a coarsest grid of at least 2");
+        }
+        base = 0;
+        plain.resize(levels);
+        plainSeconds.assign(levels, 0.0);
+        corrections.resize(levels);
+        correctionSeconds.assign(levels, 0.0);
+    }
+    
+    // Samples until the 95% confidence half-width is about targetHalfWidth:
+    // plain and coupled pilots on every level, the base level with the least
+    // predicted cost, then the optimal N_l from the measured variances and
+    // costs, re-estimated until no level needs more
+    void run(double targetHalfWidth, int pilotSamples = 50) {
+        if (targetHalfWidth <= 0) {
+            throw std::invalid_argument("Target half-width must be positive");
+        }
+        if (pilotSamples < 2) {
+            throw std::invalid_argument("Pilot needs at least two samples per level");
+        }
+        
+        for (int l = 0; l < levelCount; l++) {
+            sample(l, false, pilotSamples - plain[l].size());
+            if (l > 0) sample(l, true, pilotSamples - corrections[l].size());
+        }
+        
+        // Total cost to a fixed variance is proportional to sumRootCost^2
+        base = 0;
+        for (int from = 1; from < levelCount; from++) {
+            if (sumRootCost(from) < sumRootCost(base)) base = from;
+        }
+        
+        double epsilon = targetHalfWidth / 1.96;
+        for (int round = 0; round < 4; round++) {
+            double sumRoots = sumRootCost(base);
+            bool added = false;
+            for (int l = base; l < levelCount; l++) {
+                const StatsAccumulator& term = termOf(l, base);
+                double optimal = std::sqrt(term.variance() / termCost(l, base)) * sumRoots / (epsilon * epsilon);
+                long long extra = (long long)std::ceil(optimal) - term.size();
+                if (extra > 0) {
+                    sample(l, l > base, extra);
+                    added = true;
+                }
+            }
+            if (!added) break;
+        }
+    }
+    
+    // grid size of the base level chosen by run()
+    int baseSize() const {
+        return sizeOf(base);
+    }
+    
+    // estimated mean threshold at n: base mean plus the corrections above it
+    double mean() const {
+        double total = 0.0;
+        for (int l = base; l < levelCount; l++) total += termOf(l, base).mean();
+        return total;
+    }
+    
+    double standardError() const {
+        double variance = 0.0;
+        for (int l = base; l < levelCount; l++) {
+            const StatsAccumulator& term = termOf(l, base);
+            variance += term.variance() / term.size();
+        }
+        return std::sqrt(variance);
+    }
+    
+    // low endpoint of 95% confidence interval
+    double confidenceLow() const {
+        return mean() - 1.96 * standardError();
+    }
+    
+    // high endpoint of 95% confidence interval
+    double confidenceHigh() const {
+        return mean() + 1.96 * standardError();
+    }
+    
+    // CPU seconds spent sampling, pilots included, all levels and threads
+    double cpuSeconds() const {
+        double total = 0.0;
+        for (int l = 0; l < levelCount; l++) total += plainSeconds[l] + correctionSeconds[l];
+        return total;
+    }
+    
+    // predicted CPU seconds for plain sampling at n to the same standard error
+    double plainCpuSeconds() const {
+        double error = standardError();
+        return plain[levelCount - 1].variance() * termCost(levelCount - 1, levelCount - 1) / (error * error);
+    }
+    
+    // the levels in use, base level first
+    std::vector<LevelReport> levels() const {
+        std::vector<LevelReport> result;
+        for (int l = base; l < levelCount; l++) {
+            const StatsAccumulator& term = termOf(l, base);
+            result.push_back(LevelReport{sizeOf(l), l == base, term.size(), term.mean(), term.variance(), termCost(l, base)});
+        }
+        return result;
+    }
+    
+    // per-level table followed by the estimate
+    void print(std::ostream& out) const {
+        out << std::setw(8) << "n" << std::setw(10) << "samples" << std::setw(12) << "mean"
+            << std::setw(14) << "variance" << std::setw(14) << "s/sample" << std::endl;
+        for (const auto& level : levels()) {
+            out << std::setw(8) << level.n << std::setw(10) << level.samples
+                << std::fixed << std::setprecision(6) << std::setw(12) << level.mean
+                << std::scientific << std::setprecision(3) << std::setw(14) << level.variance
+                << std::setw(14) << level.secondsPerSample << std::endl;
+        }
+        out << std::fixed << std::setprecision(6);
+        out << "mean()           = " << mean() << std::endl;
+        out << "standard error   = " << standardError() << std::endl;
+        out << "confidenceLow()  = " << confidenceLow() << std::endl;
+        out << "confidenceHigh() = " << confidenceHigh() << std::endl;
+        out << "cpu seconds      = " << cpuSeconds() << " (pilots included)" << std::endl;
+        out << "plain at n       = " << plainCpuSeconds() << " cpu seconds predicted for the same error" << std::endl;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing MultilevelStats class..." << std::endl;
+        
+        // Coupled corrections must telescope: E[T(16) - quadrants] = E[T(16)] - E[T(8)]
+        StatsAccumulator correction, fine16, plain8;
+        LevelSampler coupled(16, true, 1), plain16(16, false, 2), coarse8(8, false, 3);
+        for (int t = 0; t < 20000; t++) {
+            double threshold;
+            correction.add(coupled.draw(threshold));
+            fine16.add(plain16.draw(threshold));
+            plain8.add(coarse8.draw(threshold));
+        }
+        double difference = fine16.mean() - plain8.mean();
+        double differenceError = std::sqrt(correction.variance() / correction.size() + fine16.variance() / fine16.size()
+                                           + plain8.variance() / plain8.size());
+        std::cout << "Coupled correction matches E[T(16)] - E[T(8)]: "
+                  << (std::fabs(correction.mean() - difference) < 5 * differenceError ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        MultilevelStats mlmc(32, 3, 2);
+        mlmc.run(0.01, 20);
+        std::vector<LevelReport> report = mlmc.levels();
+        std::cout << "Levels end at n: " << report.back().n << " (expected: 32)" << std::endl;
+        std::cout << "Base level is plain: " << (report.front().base && report.front().n == mlmc.baseSize() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        std::cout << "Half-width near target: " << (1.96 * mlmc.standardError() < 0.015 ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Mean in [0.5, 0.7]: " << (mlmc.mean() > 0.5 && mlmc.mean() < 0.7 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        try {
+            MultilevelStats invalid(30, 3);
+            std::cout << "ERROR: Should have thrown exception for n not divisible by 4" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "MultilevelStats tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,267 @@
+#pragma once
+#include "Percolation.hpp"
+#include "PercolationQuickFind.hpp"
+#include "PercolationStat.hpp"
+#include "FastRandom.hpp"
+#include "BinaryIO.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+
+// what a replay did
+struct ReplayResult {
+    int steps;                    // sites opened
+    int percolatedAt;             // step (1-based) at which percolates() first held, 0 if never
+    uint64_t fullHash;            // FNV-1a over isFull() of every site after the last step
+};
+
+// The sites one trial opened, in order, as row * n + col. Recorded from a
+// trial's seed (TrialRecord::seed) it reproduces that trial exactly, and it
+// replays through any engine with the same open / percolates interface, so
+// engines can be compared on identical inputs and timed without the RNG.
+//
+// File: "PERCSEQ1", then LEB128 varints: n, seed, steps, and one zigzag
+// varint per step for the difference from the previous site id. Random
+// sites take about 3 bytes per step on a 1000 x 1000 grid, against 8 raw.
+class OpenSequence {
+private:
+    int n;
+    uint64_t seed;                // seed it was recorded from (0 if built by hand)
+    std::vector<int> order;
+    
+    static void putVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(char((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(char(value));
+    }
+    
+    static uint64_t getVarint(const std::string& in, size_t& at) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (at >= in.size()) {
+                throw std::runtime_error("Truncated open sequence");
+            }
+            uint8_t byte = uint8_t(in[at++]);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        throw std::runtime_error("Corrupt varint in open sequence");
+    }
+    
+    static uint64_t zigzag(int64_t value) {
+        return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+    }
+    
+    static int64_t unzigzag(uint64_t value) {
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+public:
+    explicit OpenSequence(int n = 1, uint64_t seed = 0) : n(n), seed(seed) {
+        if (n <= 0) {
+            throw std::invalid_argument("Grid size n must be positive");
+        }
+    }
+    
+    // Re-run the trial a checkpointed or trial-sink run seeded with `seed`:
+    // the same draws, the same rejections, stopping at the first percolating open
+    static OpenSequence record(int n, uint64_t seed) {
+        OpenSequence sequence(n, seed);
+        Percolation perc(n);
+        Xoshiro256 gen(seed);
+        while (!perc.percolates()) {
+            int row = int(gen.bounded(uint32_t(n)));
+            int col = int(gen.bounded(uint32_t(n)));
+            while (perc.isOpen(row, col)) {
+                row = int(gen.bounded(uint32_t(n)));
+                col = int(gen.bounded(uint32_t(n)));
+            }
+            perc.open(row, col);
+            sequence.add(row * n + col);
+        }
+        return sequence;
+    }
+    
+    void add(int site) {
+        if (site < 0 || site >= n * n) {
+            throw std::out_of_range("Site outside the grid");
+        }
+        order.push_back(site);
+    }
+    
+    int size() const {
+        return n;
+    }
+    
+    uint64_t recordedSeed() const {
+        return seed;
+    }
+    
+    const std::vector<int>& sites() const {
+        return order;
+    }
+    
+    // FNV-1a over isFull() of every site, row by row
+    template <typename Engine>
+    uint64_t fullSitesHash(Engine& engine) const {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (int row = 0; row < n; row++) {
+            for (int col = 0; col < n; col++) {
+                hash = (hash ^ uint64_t(engine.isFull(row, col))) * 0x100000001b3ULL;
+            }
+        }
+        return hash;
+    }
+    
+    // Open every site in order on a fresh engine, checking after each step
+    // that the grid percolates exactly at the last one; throws on divergence.
+    // The full sites at the end are fingerprinted for comparing engines.
+    template <typename Engine>
+    ReplayResult replay() const {
+        Engine engine(n);
+        ReplayResult result{0, 0, 0};
+        int steps = int(order.size());
+        for (int i = 0; i < steps; i++) {
+            int row = order[i] / n, col = order[i] % n;
+            if (engine.isOpen(row, col)) {
+                throw std::runtime_error("Replay step " + std::to_string(i + 1) + " reopens an open site");
+            }
+            engine.open(row, col);
+            bool percolates = engine.percolates();
+            if (percolates != (i + 1 == steps)) {
+                throw std::runtime_error("Replay diverged at step " + std::to_string(i + 1) + " of " + std::to_string(steps)
+                                         + (percolates ? ": percolated early" : ": not yet percolating"));
+            }
+            if (percolates) result.percolatedAt = i + 1;
+            result.steps++;
+        }
+        result.fullHash = fullSitesHash(engine);
+        return result;
+    }
+    
+    // Opens and percolation checks only, for timing: what a trial does minus its RNG
+    template <typename Engine>
+    int replayUnchecked(Engine& engine) const {
+        int percolatedAt = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            engine.open(order[i] / n, order[i] % n);
+            if (engine.percolates() && percolatedAt == 0) percolatedAt = int(i) + 1;
+        }
+        return percolatedAt;
+    }
+    
+    std::string encode() const {
+        std::string out("PERCSEQ1");
+        putVarint(out, uint64_t(n));
+        putVarint(out, seed);
+        putVarint(out, order.size());
+        int previous = 0;
+        for (int site : order) {
+            putVarint(out, zigzag(int64_t(site) - previous));
+            previous = site;
+        }
+        return out;
+    }
+    
+    static OpenSequence decode(const std::string& bytes) {
+        if (bytes.compare(0, 8, "PERCSEQ1") != 0) {
+            throw std::runtime_error("Not an open sequence");
+        }
+        size_t at = 8;
+        uint64_t n = getVarint(bytes, at);
+        uint64_t seed = getVarint(bytes, at);
+        uint64_t steps = getVarint(bytes, at);
+        if (n == 0 || n > 46340 || steps > n * n) {
+            throw std::runtime_error("Corrupt open sequence header");
+        }
+        OpenSequence sequence(int(n), seed);
+        sequence.order.reserve(size_t(steps));
+        int64_t site = 0;
+        for (uint64_t i = 0; i < steps; i++) {
+            site += unzigzag(getVarint(bytes, at));
+            if (site < 0 || site >= int64_t(n * n)) {
+                throw std::runtime_error("Open sequence leaves the grid at step " + std::to_string(i + 1));
+            }
+            sequence.order.push_back(int(site));
+        }
+        if (at != bytes.size()) {
+            throw std::runtime_error("Trailing bytes after open sequence");
+        }
+        return sequence;
+    }
+    
+    void save(const std::string& path) const {
+        BinaryIO::replaceFile(path, encode());
+    }
+    
+    static OpenSequence load(const std::string& path) {
+        std::string bytes;
+        if (!BinaryIO::readFile(path, bytes)) {
+            throw std::runtime_error("Cannot open sequence file: " + path);
+        }
+        try {
+            return decode(bytes);
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error(std::string(e.what()) + ": " + path);
+        }
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing OpenSequence class..." << std::endl;
+        
+        OpenSequence recorded = record(50, 12345);
+        OpenSequence decoded = decode(recorded.encode());
+        std::cout << "Decoded sequence identical: " << (decoded.sites() == recorded.sites() && decoded.recordedSeed() == 12345 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        double bytesPerStep = double(recorded.encode().size()) / recorded.sites().size();
+        std::cout << "Under 3 bytes per step on 50x50: " << (bytesPerStep < 3.0 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // The recording must be the very trial a seeded run performed
+        struct LastTrial : TrialSink {
+            TrialRecord last{};
+            void write(const TrialRecord* records, size_t count) override {
+                last = records[count - 1];
+            }
+        } sink;
+        StatsOptions options;
+        options.seed = 99;
+        options.trialSink = &sink;
+        PercolationStats stats(50, 5, options);
+        OpenSequence trial = record(50, sink.last.seed);
+        std::cout << "Recorded trial opens as many sites as the run: "
+                  << (int(trial.sites().size()) == sink.last.openSites ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        ReplayResult weighted = decoded.replay<Percolation>();
+        ReplayResult quick = decoded.replay<PercolationQuickFind>();
+        std::cout << "Percolates at last step: " << (weighted.percolatedAt == int(recorded.sites().size()) ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        std::cout << "Engines agree on full sites: " << (weighted.fullHash == quick.fullHash && quick.percolatedAt == weighted.percolatedAt ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        Percolation perc(50);
+        std::cout << "Unchecked replay percolates at: " << decoded.replayUnchecked(perc) << " (expected: " << weighted.percolatedAt << ")" << std::endl;
+        
+        // A truncated sequence never percolates, and the replay says where
+        OpenSequence cut(50);
+        for (size_t i = 0; i + 1 < recorded.sites().size(); i++) cut.add(recorded.sites()[i]);
+        try {
+            cut.replay<Percolation>();
+            std::cout << "ERROR: Should have thrown exception for a diverging replay" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Correctly caught runtime error: " << e.what() << std::endl;
+        }
+        try {
+            decode(recorded.encode().substr(0, 20));
+            std::cout << "ERROR: Should have thrown exception for a truncated sequence" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Correctly caught runtime error: " << e.what() << std::endl;
+        }
+        
+        std::cout << "OpenSequence tests completed." << std::endl;
+    }
+};
@@ -1,17 +1,36 @@
 #pragma once
+#include "EngineCounters.hpp"
 #include <vector>
+#include <algorithm>
+#include <numeric>
 #include <stdexcept>
 #include <iostream>
 
+class Microbenchmark;
+
 class Percolation {
 private:
+    friend class Microbenchmark;     // times find() and unionSites() directly
+    
     int n;
     std::vector<bool> grid;           // true if site is open
     std::vector<int> parent;          // parent array for union-find
-    std::vector<int> size;            // size array for weighted union
+    std::vector<int> size;            // open sites per component
+    std::vector<unsigned char> edges; // per root: which of the top / bottom rows the component touches
+    std::vector<int> clusterCounts;   // clusterCounts[s] = number of clusters with s open sites (empty unless asked for)
     int openSitesCount;
-    int virtualTop;                   // virtual top site index
-    int virtualBottom;                // virtual bottom site index
+    int clusterCount;                 // number of clusters of open sites
+    int largestCluster;               // open sites in the largest cluster
+    long long sumSquaredSizes;        // sum over clusters of size^2
+    int spanningRoot;                 // a site of the first component to touch both rows, -1 if none
+    
+    // Components track the boundary rows they touch instead of joining
+    // virtual top / bottom sites, which would merge unrelated clusters
+    static const unsigned char TOP = 1;
+    static const unsigned char BOTTOM = 2;
+#ifdef PERCOLATION_COUNTERS
+    EngineCounters engineCounters;    // find paths and unions since construction
+#endif
     
     // Convert 2D coordinates to 1D index
     int getIndex(int row, int col) const {
@@ -27,8 +46,17 @@ private:
     
     // Find root with path compression
     int find(int x) {
+#ifdef PERCOLATION_COUNTERS
+        int length = 0;
+        for (int y = x; parent[y] != y; y = parent[y]) length++;
+        engineCounters.recordFind(length);
+#endif
+        return compress(x);
+    }
+    
+    int compress(int x) {
         if (parent[x] != x) {
-            parent[x] = find(parent[x]);  // path compression
+            parent[x] = compress(parent[x]);  // path compression
         }
         return parent[x];
     }
@@ -37,49 +65,80 @@ private:
     void unionSites(int x, int y) {
         int rootX = find(x);
         int rootY = find(y);
+        PERCOLATION_COUNT(engineCounters.unions++);
         
-        if (rootX == rootY) return;
+        if (rootX == rootY) {
+            PERCOLATION_COUNT(engineCounters.redundantUnions++);
+            return;
+        }
+        
+        // Cluster bookkeeping, O(1) per union
+        int sizeX = size[rootX];
+        int sizeY = size[rootY];
+        if (!clusterCounts.empty()) {
+            clusterCounts[sizeX]--;
+            clusterCounts[sizeY]--;
+            clusterCounts[sizeX + sizeY]++;
+        }
+        clusterCount--;
+        largestCluster = std::max(largestCluster, sizeX + sizeY);
+        sumSquaredSizes += 2LL * sizeX * sizeY;
         
         // Weighted union: attach smaller tree to larger tree
         if (size[rootX] < size[rootY]) {
-            parent[rootX] = rootY;
-            size[rootY] += size[rootX];
-        } else {
-            parent[rootY] = rootX;
-            size[rootX] += size[rootY];
+            std::swap(rootX, rootY);
+        }
+        parent[rootY] = rootX;
+        size[rootX] += size[rootY];
+        edges[rootX] |= edges[rootY];
+        if (edges[rootX] == (TOP | BOTTOM) && spanningRoot < 0) {
+            spanningRoot = rootX;
         }
-    }
-    
-    // Check if two sites are connected
-    bool connected(int x, int y) {
-        return find(x) == find(y);
     }
 
 public:
-    // creates n-by-n grid, with all sites initially blocked
-    Percolation(int n) {
+    // creates n-by-n grid, with all sites initially blocked; clusterHistogram
+    // also keeps clusterSizeHistogram(), n*n+1 ints (4 more bytes per site)
+    Percolation(int n, bool clusterHistogram = false) {
         if (n <= 0) {
             throw std::invalid_argument("Grid size must be positive");
         }
         
         this->n = n;
         this->openSitesCount = 0;
+        this->clusterCount = 0;
+        this->largestCluster = 0;
+        this->sumSquaredSizes = 0;
+        this->spanningRoot = -1;
         
         // Initialize grid (all blocked)
         grid.resize(n * n, false);
         
-        // Initialize union-find with 2 extra sites for virtual top and bottom
-        int totalSites = n * n + 2;
+        // Initialize union-find, one entry per site
+        int totalSites = n * n;
         parent.resize(totalSites);
         size.resize(totalSites, 1);
+        edges.resize(totalSites, 0);
         
         // Initialize parent array
         for (int i = 0; i < totalSites; i++) {
             parent[i] = i;
         }
-        
-        virtualTop = n * n;
-        virtualBottom = n * n + 1;
+        if (clusterHistogram) clusterCounts.resize(n * n + 1, 0);
+    }
+    
+    // blocks every site again, reusing the already allocated arrays
+    void reset() {
+        std::fill(grid.begin(), grid.end(), false);
+        std::fill(size.begin(), size.end(), 1);
+        std::fill(edges.begin(), edges.end(), 0);
+        std::iota(parent.begin(), parent.end(), 0);
+        std::fill(clusterCounts.begin(), clusterCounts.end(), 0);
+        openSitesCount = 0;
+        clusterCount = 0;
+        largestCluster = 0;
+        sumSquaredSizes = 0;
+        spanningRoot = -1;
     }
     
     // opens the site (row, col) if it is not open already
@@ -92,15 +151,16 @@ public:
         grid[index] = true;
         openSitesCount++;
         
-        // Connect to virtual top if in top row
-        if (row == 0) {
-            unionSites(index, virtualTop);
-        }
+        // A new site starts as a cluster of its own
+        if (!clusterCounts.empty()) clusterCounts[1]++;
+        clusterCount++;
+        largestCluster = std::max(largestCluster, 1);
+        sumSquaredSizes++;
         
-        // Connect to virtual bottom if in bottom row
-        if (row == n - 1) {
-            unionSites(index, virtualBottom);
-        }
+        // Mark contact with the top and bottom rows
+        if (row == 0) edges[index] |= TOP;
+        if (row == n - 1) edges[index] |= BOTTOM;
+        if (edges[index] == (TOP | BOTTOM)) spanningRoot = index;
         
         // Connect to open neighbors
         // Check up
@@ -124,6 +184,21 @@ public:
         }
     }
     
+    // Hint the caches about the union-find entries open(row, col) is about
+    // to touch. The grid itself is a bit vector, small enough to stay cached.
+    void prefetch(int row, int col) const {
+#if defined(__GNUC__)
+        int index = getIndex(row, col);
+        __builtin_prefetch(&parent[index]);
+        __builtin_prefetch(&size[index]);
+        if (row > 0) __builtin_prefetch(&parent[index - n]);
+        if (row < n - 1) __builtin_prefetch(&parent[index + n]);
+#else
+        (void)row;
+        (void)col;
+#endif
+    }
+    
     // is the site (row, col) open?
     bool isOpen(int row, int col) {
         validate(row, col);
@@ -135,7 +210,7 @@ public:
         validate(row, col);
         if (!isOpen(row, col)) return false;
         
-        return connected(getIndex(row, col), virtualTop);
+        return (edges[find(getIndex(row, col))] & TOP) != 0;
     }
     
     // returns the number of open sites
@@ -143,9 +218,65 @@ public:
         return openSitesCount;
     }
     
+    // bytes held by this grid: the object plus every array it owns
+    size_t bytesAllocated() const {
+        return sizeof(*this) + (grid.capacity() + 63) / 64 * 8
+             + (parent.capacity() + size.capacity() + clusterCounts.capacity()) * sizeof(int) + edges.capacity();
+    }
+    
+    double bytesPerSite() const {
+        return double(bytesAllocated()) / (double(n) * n);
+    }
+    
+    // what an n-by-n grid allocates, without building one (no cluster histogram)
+    static size_t bytesFor(int n) {
+        size_t sites = size_t(n) * n;
+        return sizeof(Percolation) + (sites + 63) / 64 * 8 + 2 * sites * sizeof(int) + sites;
+    }
+    
     // does the system percolate?
     bool percolates() {
-        return connected(virtualTop, virtualBottom);
+        return spanningRoot >= 0;
+    }
+
+#ifdef PERCOLATION_COUNTERS
+    // find paths and unions since construction (not cleared by reset())
+    const EngineCounters& counters() const {
+        return engineCounters;
+    }
+
+#endif
+    // returns the number of clusters of open sites
+    int numberOfClusters() const {
+        return clusterCount;
+    }
+    
+    // returns the number of open sites in the largest cluster
+    int largestClusterSize() const {
+        return largestCluster;
+    }
+    
+    // histogram[s] = number of clusters with s open sites, s in [0, n*n];
+    // only kept by a grid constructed with clusterHistogram
+    const std::vector<int>& clusterSizeHistogram() const {
+        if (clusterCounts.empty()) {
+            throw std::logic_error("Cluster histogram needs Percolation(n, true)");
+        }
+        return clusterCounts;
+    }
+    
+    // open sites in the cluster joining top and bottom, 0 if none
+    int spanningClusterSize() {
+        if (!percolates()) return 0;
+        return size[find(spanningRoot)];
+    }
+    
+    // mean size of the cluster containing a random open site, leaving out
+    // the largest cluster (the usual susceptibility-like average)
+    double meanClusterSize() const {
+        long long rest = openSitesCount - largestCluster;
+        if (rest <= 0) return 0.0;
+        return double(sumSquaredSizes - (long long)largestCluster * largestCluster) / rest;
     }
     
     // unit testing (required)
@@ -172,6 +303,41 @@ public:
         std::cout << "Open sites: " << perc.numberOfOpenSites() << std::endl;
         std::cout << "System percolates: " << (perc.percolates() ? "true" : "false") << std::endl;
         
+        // Cluster tracking: the path above is one cluster of three sites
+        std::cout << "Largest cluster: " << perc.largestClusterSize() << " (expected: 3)" << std::endl;
+        std::cout << "Spanning cluster: " << perc.spanningClusterSize() << " (expected: 3)" << std::endl;
+        
+        Percolation clusters(3, true);
+        clusters.open(0, 0);
+        clusters.open(0, 2);
+        clusters.open(1, 2);
+        clusters.open(2, 0);
+        std::cout << "Clusters {1,2,1}: " << clusters.numberOfClusters() << " clusters, histogram[1] = "
+                  << clusters.clusterSizeHistogram()[1] << ", histogram[2] = " << clusters.clusterSizeHistogram()[2]
+                  << " (expected: 3 clusters, 2, 1)" << std::endl;
+        std::cout << "Mean cluster size without largest: " << clusters.meanClusterSize() << " (expected: 1)" << std::endl;
+        clusters.reset();
+        std::cout << "After reset: " << clusters.numberOfClusters() << " clusters, largest " << clusters.largestClusterSize()
+                  << " (expected: 0 clusters, largest 0)" << std::endl;
+        
+        // A bottom-row site is only full through its own cluster (no backwash)
+        Percolation backwash(3);
+        backwash.open(0, 0);
+        backwash.open(1, 0);
+        backwash.open(2, 0);
+        backwash.open(2, 2);
+        std::cout << "Site (2,2) is full after percolation: " << (backwash.isFull(2, 2) ? "true" : "false") << " (expected: false)" << std::endl;
+        
+        // Footprint predicted without a grid matches the grid's own accounting
+        Percolation sized(100);
+        std::cout << "bytesFor(100) matches bytesAllocated(): " << (bytesFor(100) == sized.bytesAllocated() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        std::cout << "Bytes per site below 9.2: " << (sized.bytesPerSite() < 9.2 ? "true" : "false") << " (expected: true)" << std::endl;
+        Percolation histogram(100, true);
+        std::cout << "Cluster histogram adds 4 bytes per site: "
+                  << (histogram.bytesAllocated() - sized.bytesAllocated() == (100 * 100 + 1) * sizeof(int) ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
         // Test error cases
         try {
             perc.open(-1, 0);
@@ -0,0 +1,279 @@
+#pragma once
+#include "FastRandom.hpp"
+#include "Percolation.hpp"
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <iostream>
+
+// Bit-sliced canonical-ensemble engine: every site is a 64-bit word and
+// bit k of each word belongs to independent trial k, so a single flood fill
+// answers "does the grid percolate at occupation p" for 64 grids at once.
+class PercolationBitSliced {
+private:
+    int n;
+    std::vector<uint64_t> openMask;   // bit k set if site is open in trial k
+    std::vector<uint64_t> fullMask;   // bit k set if site is full in trial k
+    Xoshiro256 gen;
+    
+    // Convert 2D coordinates to 1D index
+    int getIndex(int row, int col) const {
+        return row * n + col;
+    }
+    
+    // Validate coordinates and trial lane
+    void validate(int row, int col, int trial) const {
+        if (row < 0 || row >= n || col < 0 || col >= n) {
+            throw std::invalid_argument("Index out of bounds");
+        }
+        if (trial < 0 || trial >= TRIALS_PER_WORD) {
+            throw std::invalid_argument("Trial lane out of bounds");
+        }
+    }
+    
+    // Mask with every bit set independently with probability p32 / 2^32.
+    // Walks the binary expansion of p from the least significant set bit
+    // upwards: a 1 bit ORs in a fresh random word, a 0 bit ANDs one in.
+    uint64_t bernoulliMask(uint64_t p32) {
+        if (p32 == 0) return 0;
+        if (p32 >= (1ULL << 32)) return ~0ULL;
+        
+        int bit = 0;
+        while (((p32 >> bit) & 1) == 0) bit++;
+        
+        uint64_t mask = gen();
+        for (bit++; bit < 32; bit++) {
+            if ((p32 >> bit) & 1) {
+                mask |= gen();
+            } else {
+                mask &= gen();
+            }
+        }
+        return mask;
+    }
+    
+    // Close a row horizontally: fullness spreads left then right through open sites
+    void spreadRow(int row) {
+        uint64_t* f = &fullMask[getIndex(row, 0)];
+        const uint64_t* o = &openMask[getIndex(row, 0)];
+        
+        for (int col = 1; col < n; col++) {
+            f[col] |= f[col - 1] & o[col];
+        }
+        for (int col = n - 2; col >= 0; col--) {
+            f[col] |= f[col + 1] & o[col];
+        }
+    }
+    
+    // Pull fullness into row from a vertical neighbour row. Written as a
+    // plain element-wise loop so the compiler can vectorize it.
+    bool spreadFrom(int row, int fromRow) {
+        uint64_t* f = &fullMask[getIndex(row, 0)];
+        const uint64_t* src = &fullMask[getIndex(fromRow, 0)];
+        const uint64_t* o = &openMask[getIndex(row, 0)];
+        uint64_t diff = 0;
+        
+        for (int col = 0; col < n; col++) {
+            uint64_t next = f[col] | (src[col] & o[col]);
+            diff |= next ^ f[col];
+            f[col] = next;
+        }
+        return diff != 0;
+    }
+
+public:
+    static const int TRIALS_PER_WORD = 64;
+    
+    // creates n-by-n grid for 64 trials, with all sites initially blocked
+    PercolationBitSliced(int n, uint64_t seed = std::random_device{}()) : gen(seed) {
+        if (n <= 0) {
+            throw std::invalid_argument("Grid size must be positive");
+        }
+        
+        this->n = n;
+        openMask.assign(n * n, 0);
+        fullMask.assign(n * n, 0);
+    }
+    
+    // bytes held by this engine; every site costs two words for 64 trials
+    size_t bytesAllocated() const {
+        return sizeof(*this) + (openMask.capacity() + fullMask.capacity()) * sizeof(uint64_t);
+    }
+    
+    double bytesPerSite() const {
+        return double(bytesAllocated()) / (double(n) * n);
+    }
+    
+    // what an n-by-n engine allocates, without building one
+    static size_t bytesFor(int n) {
+        return sizeof(PercolationBitSliced) + 2 * size_t(n) * n * sizeof(uint64_t);
+    }
+    
+    // draws a fresh grid for every trial: each site open with probability p
+    void fill(double p) {
+        if (p < 0.0 || p > 1.0) {
+            throw std::invalid_argument("Occupation probability must be in [0, 1]");
+        }
+        
+        uint64_t p32 = (uint64_t)(p * 4294967296.0 + 0.5);
+        for (uint64_t& word : openMask) {
+            word = bernoulliMask(p32);
+        }
+    }
+    
+    // blocks every site in every trial
+    void clear() {
+        std::fill(openMask.begin(), openMask.end(), 0);
+        std::fill(fullMask.begin(), fullMask.end(), 0);
+    }
+    
+    // opens the site (row, col) in a single trial
+    void open(int row, int col, int trial) {
+        validate(row, col, trial);
+        openMask[getIndex(row, col)] |= 1ULL << trial;
+    }
+    
+    // is the site (row, col) open in the given trial?
+    bool isOpen(int row, int col, int trial) const {
+        validate(row, col, trial);
+        return (openMask[getIndex(row, col)] >> trial) & 1;
+    }
+    
+    // is the site (row, col) full in the given trial? (valid after percolates())
+    bool isFull(int row, int col, int trial) const {
+        validate(row, col, trial);
+        return (fullMask[getIndex(row, col)] >> trial) & 1;
+    }
+    
+    // flood fills from the top row in all trials until a fixpoint;
+    // bit k of the result is set if trial k percolates
+    uint64_t percolates() {
+        std::fill(fullMask.begin(), fullMask.end(), 0);
+        for (int col = 0; col < n; col++) {
+            fullMask[col] = openMask[col];
+        }
+        
+        bool changed = true;
+        while (changed) {
+            // Downward sweep
+            for (int row = 1; row < n; row++) {
+                if (spreadFrom(row, row - 1)) spreadRow(row);
+            }
+            
+            // Upward sweep
+            bool upChanged = false;
+            for (int row = n - 2; row >= 0; row--) {
+                bool rowChanged = spreadFrom(row, row + 1);
+                if (rowChanged) spreadRow(row);
+                upChanged |= rowChanged;
+            }
+            
+            // Another downward sweep is only needed if fullness moved up
+            changed = upChanged;
+        }
+        
+        uint64_t result = 0;
+        for (int col = 0; col < n; col++) {
+            result |= fullMask[getIndex(n - 1, col)];
+        }
+        return result;
+    }
+    
+    // fraction of grids that percolate at occupation p, rounded up to whole words of trials
+    static double percolationProbability(int n, double p, int trials, uint64_t seed = std::random_device{}()) {
+        if (trials <= 0) {
+            throw std::invalid_argument("Number of trials must be positive");
+        }
+        
+        PercolationBitSliced engine(n, seed);
+        int words = (trials + TRIALS_PER_WORD - 1) / TRIALS_PER_WORD;
+        long long percolating = 0;
+        for (int w = 0; w < words; w++) {
+            engine.fill(p);
+            percolating += __builtin_popcountll(engine.percolates());
+        }
+        return static_cast<double>(percolating) / ((long long)words * TRIALS_PER_WORD);
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing PercolationBitSliced class..." << std::endl;
+        
+        PercolationBitSliced engine(4, 12345);
+        
+        // Trial 0: straight column, trial 1: blocked column, trial 2: snake path
+        for (int row = 0; row < 4; row++) {
+            engine.open(row, 1, 0);
+        }
+        engine.open(0, 0, 1);
+        engine.open(1, 0, 1);
+        engine.open(3, 0, 1);
+        int snake[][2] = {{0, 3}, {1, 3}, {1, 2}, {1, 1}, {1, 0}, {2, 0}, {3, 0}};
+        for (auto& site : snake) {
+            engine.open(site[0], site[1], 2);
+        }
+        
+        uint64_t mask = engine.percolates();
+        std::cout << "Straight column percolates: " << ((mask & 1) ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Blocked column percolates: " << ((mask & 2) ? "true" : "false") << " (expected: false)" << std::endl;
+        std::cout << "Snake path percolates: " << ((mask & 4) ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Site (3,0) full in snake trial: " << (engine.isFull(3, 0, 2) ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Site (3,0) full in blocked trial: " << (engine.isFull(3, 0, 1) ? "true" : "false") << " (expected: false)" << std::endl;
+        
+        // Degenerate occupations
+        std::cout << "P(percolates) at p=0: " << percolationProbability(8, 0.0, 64) << " (expected: 0)" << std::endl;
+        std::cout << "P(percolates) at p=1: " << percolationProbability(8, 1.0, 64) << " (expected: 1)" << std::endl;
+        std::cout << "bytesFor(4) matches bytesAllocated(): " << (bytesFor(4) == engine.bytesAllocated() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // The word-level Bernoulli construction must open sites at rate p:
+        // 65536 site-trials, so 4 standard errors is under 0.01
+        PercolationBitSliced sampler(32, 777);
+        for (double p : {0.3, 0.593}) {
+            sampler.fill(p);
+            long long open = 0;
+            for (uint64_t word : sampler.openMask) open += __builtin_popcountll(word);
+            double sites = double(sampler.openMask.size()) * TRIALS_PER_WORD;
+            double standardError = std::sqrt(p * (1.0 - p) / sites);
+            std::cout << "Open fraction at p=" << p << " within 4 standard errors: "
+                      << (std::fabs(open / sites - p) < 4.0 * standardError ? "true" : "false") << " (expected: true)" << std::endl;
+        }
+        
+        // Every lane of a random fill must agree with Percolation fed the same open sites
+        int size = 16;
+        PercolationBitSliced lanes(size, 4242);
+        lanes.fill(0.593);
+        uint64_t percolating = lanes.percolates();
+        bool agree = true;
+        for (int trial = 0; trial < TRIALS_PER_WORD; trial++) {
+            Percolation perc(size);
+            for (int row = 0; row < size; row++) {
+                for (int col = 0; col < size; col++) {
+                    if (lanes.isOpen(row, col, trial)) perc.open(row, col);
+                }
+            }
+            agree &= perc.percolates() == bool((percolating >> trial) & 1);
+            for (int row = 0; row < size; row++) {
+                for (int col = 0; col < size; col++) {
+                    agree &= perc.isFull(row, col) == lanes.isFull(row, col, trial);
+                }
+            }
+        }
+        std::cout << "All 64 lanes match Percolation (percolates and isFull): " << (agree ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        std::cout << "Some but not all lanes percolate: "
+                  << (percolating != 0 && percolating != ~0ULL ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        try {
+            engine.open(0, 0, 64);
+            std::cout << "ERROR: Should have thrown exception for invalid trial lane" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "PercolationBitSliced tests completed." << std::endl;
+    }
+};
@@ -1,17 +1,25 @@
 #pragma once
+#include "EngineCounters.hpp"
 #include <vector>
 #include <stdexcept>
 #include <iostream>
 
+class Microbenchmark;
+
 // Quick-Find implementation for comparison
 class PercolationQuickFind {
 private:
+    friend class Microbenchmark;     // times find() and unionSites() directly
+    
     int n;
     std::vector<bool> grid;           // true if site is open
     std::vector<int> id;              // id array for quick-find
     int openSitesCount;
     int virtualTop;                   // virtual top site index
-    int virtualBottom;                // virtual bottom site index
+    bool percolating;                 // a full site in the bottom row
+#ifdef PERCOLATION_COUNTERS
+    EngineCounters engineCounters;    // finds, unions and relabels since construction
+#endif
     
     // Convert 2D coordinates to 1D index
     int getIndex(int row, int col) const {
@@ -27,6 +35,7 @@ private:
     
     // Find operation - O(1)
     int find(int x) {
+        PERCOLATION_COUNT(engineCounters.recordFind(0));
         return id[x];
     }
     
@@ -34,13 +43,18 @@ private:
     void unionSites(int x, int y) {
         int idX = find(x);
         int idY = find(y);
+        PERCOLATION_COUNT(engineCounters.unions++);
         
-        if (idX == idY) return;
+        if (idX == idY) {
+            PERCOLATION_COUNT(engineCounters.redundantUnions++);
+            return;
+        }
         
         // Change all entries with id[x] to id[y]
         for (int i = 0; i < int(id.size()); i++) {
             if (id[i] == idX) {
                 id[i] = idY;
+                PERCOLATION_COUNT(engineCounters.relabels++);
             }
         }
     }
@@ -63,8 +77,10 @@ public:
         // Initialize grid (all blocked)
         grid.resize(n * n, false);
         
-        // Initialize quick-find with 2 extra sites for virtual top and bottom
-        int totalSites = n * n + 2;
+        // Initialize quick-find with 1 extra site for the virtual top. There is
+        // no virtual bottom: it would make bottom-row sites full through any
+        // percolating path (backwash), unlike Percolation::isFull
+        int totalSites = n * n + 1;
         id.resize(totalSites);
         
         // Initialize id array
@@ -73,7 +89,7 @@ public:
         }
         
         virtualTop = n * n;
-        virtualBottom = n * n + 1;
+        percolating = false;
     }
     
     // opens the site (row, col) if it is not open already
@@ -91,11 +107,6 @@ public:
             unionSites(index, virtualTop);
         }
         
-        // Connect to virtual bottom if in bottom row
-        if (row == n - 1) {
-            unionSites(index, virtualBottom);
-        }
-        
         // Connect to open neighbors
         // Check up
         if (row > 0 && isOpen(row - 1, col)) {
@@ -116,6 +127,15 @@ public:
         if (col < n - 1 && isOpen(row, col + 1)) {
             unionSites(index, getIndex(row, col + 1));
         }
+        
+        // Only the new site's component changed; if it is full, look for it
+        // in the bottom row - O(n), well under the O(n^2) union
+        if (!percolating && connected(index, virtualTop)) {
+            for (int c = 0; c < n && !percolating; c++) {
+                int bottom = getIndex(n - 1, c);
+                percolating = grid[bottom] && connected(bottom, virtualTop);
+            }
+        }
     }
     
     // is the site (row, col) open?
@@ -137,8 +157,30 @@ public:
         return openSitesCount;
     }
     
+    // bytes held by this grid: the object plus every array it owns
+    size_t bytesAllocated() const {
+        return sizeof(*this) + (grid.capacity() + 63) / 64 * 8 + id.capacity() * sizeof(int);
+    }
+    
+    double bytesPerSite() const {
+        return double(bytesAllocated()) / (double(n) * n);
+    }
+    
+    // what an n-by-n grid allocates, without building one
+    static size_t bytesFor(int n) {
+        size_t sites = size_t(n) * n;
+        return sizeof(PercolationQuickFind) + (sites + 63) / 64 * 8 + (sites + 1) * sizeof(int);
+    }
+
+#ifdef PERCOLATION_COUNTERS
+    // finds, unions and relabels since construction
+    const EngineCounters& counters() const {
+        return engineCounters;
+    }
+
+#endif
     // does the system percolate?
     bool percolates() {
-        return connected(virtualTop, virtualBottom);
+        return percolating;
     }
 };
@@ -1,74 +1,697 @@
 #pragma once
 #include "Percolation.hpp"
+#include "WorkerPool.hpp"
+#include "Stopwatch.hpp"
+#include "RingBuffer.hpp"
+#include "FastRandom.hpp"
+#include "StatsAccumulator.hpp"
+#include "QuantileSketch.hpp"
+#include "Bootstrap.hpp"
+#include "PerfCounters.hpp"
+#include "Tracer.hpp"
+#include "BinaryIO.hpp"
+#include "TrialSink.hpp"
 #include <vector>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <thread>
 #include <random>
 #include <cmath>
+#include <cstdio>
 #include <stdexcept>
 #include <iostream>
+#include <iomanip>
+
+// options for PercolationStats runs
+struct StatsOptions {
+    int threads = 1;              // number of worker threads
+    bool pinThreads = false;      // pin each worker to its own core
+    bool pipelined = false;       // one generator thread shuffles site orders for the workers
+    int pipelineDepth = 4;        // permutation buffers in flight per worker when pipelined
+    int interleave = 1;           // independent trials each worker advances round-robin
+    bool retainThresholds = false; // keep every per-trial threshold (8 bytes per trial)
+    int sketchAccuracy = 200;     // k of the threshold quantile sketch (about 3k doubles)
+    bool countEvents = false;     // hardware counters around the trial loop, all workers included
+    uint64_t seed = 0;            // nonzero makes the run repeatable; 0 draws fresh seeds
+    bool phaseTiming = false;     // per-phase time breakdown of the plain worker loop
+    int phaseSampleEvery = 16;    // time one trial in this many; the rest run untimed
+    Tracer* tracer = nullptr;     // trace spans of every trial, batch and merge (not owned)
+    std::string checkpointPath;   // save progress to this file ("" = no checkpoints)
+    double checkpointSeconds = 60.0; // minimum wall time between checkpoints
+    int checkpointChunk = 1024;   // trials between the points a checkpoint can be taken at
+    bool resume = false;          // continue from checkpointPath if it exists
+    int trialBudget = 0;          // checkpointed runs: stop after this many more trials, rounded up to a chunk (0 = all)
+    TrialSink* trialSink = nullptr; // receives every trial in order, a chunk at a time (not owned)
+};
+
+// phases of one trial, as timed when options.phaseTiming is set
+enum TrialPhase {
+    PHASE_INIT,                   // resetting the grid
+    PHASE_RNG,                    // drawing a blocked site
+    PHASE_OPEN,                   // open() and its unions
+    PHASE_CHECK,                  // percolates()
+    PHASE_STATS,                  // recording the trial
+    TRIAL_PHASES
+};
+
+// what one worker did during a run
+struct WorkerReport {
+    int cpu;                      // core the worker was pinned to (-1 if unpinned)
+    int node;                     // NUMA node the worker ran on
+    int trials;                   // trials completed by the worker
+    double seconds;               // wall time the worker spent on them
+};
+
+// occupancy of one stage of a pipelined run
+struct StageReport {
+    std::string stage;            // "generator" or "solver k"
+    int items;                    // permutations produced or consumed
+    double busySeconds;           // time spent doing the stage's own work
+    double stallSeconds;          // time spent waiting on the other stage
+    double meanQueueDepth;        // ready permutations queued, sampled at each hand-off
+};
+
+// everything a worker accumulates over its trials, merged after the run
+struct TrialTally {
+    StatsAccumulator stats;       // mean / variance of the threshold
+    QuantileSketch quantiles;     // distribution of the threshold
+    StatsAccumulator clusterSize; // mean cluster size at the threshold
+    StatsAccumulator strength;    // spanning cluster's share of all sites at the threshold
+#ifdef PERCOLATION_COUNTERS
+    EngineCounters engine;        // engine work and rejected draws
+#endif
+    PhaseTimes phases;            // sampled trials only
+    
+    explicit TrialTally(int sketchAccuracy = 200)
+        : quantiles(sketchAccuracy), phases({"init", "rng", "open", "percolates", "stats"}) {}
+    
+    void add(double threshold, double meanClusterSize, double spanningStrength) {
+        stats.add(threshold);
+        quantiles.add(threshold);
+        clusterSize.add(meanClusterSize);
+        strength.add(spanningStrength);
+    }
+    
+    void merge(const TrialTally& other) {
+        stats.merge(other.stats);
+        quantiles.merge(other.quantiles);
+        clusterSize.merge(other.clusterSize);
+        strength.merge(other.strength);
+#ifdef PERCOLATION_COUNTERS
+        engine.merge(other.engine);
+#endif
+        phases.merge(other.phases);
+    }
+    
+    // the statistics only; counters and phase times describe one process's work
+    void save(std::ostream& out) const {
+        stats.save(out);
+        quantiles.save(out);
+        clusterSize.save(out);
+        strength.save(out);
+    }
+    
+    void load(std::istream& in) {
+        stats.load(in);
+        quantiles.load(in);
+        clusterSize.load(in);
+        strength.load(in);
+    }
+};
 
 class PercolationStats {
 private:
-    std::vector<double> thresholds;
+    std::vector<double> thresholds;           // only filled when options.retainThresholds
     int n;
     int trials;
-    double sampleMean;
-    double sampleStddev;
+    StatsOptions options;
+    TrialTally summary;                       // all workers' tallies merged
+    std::vector<TrialTally> partials;         // one per worker, merged after the run
+    std::vector<WorkerReport> workerReports;
+    std::vector<StageReport> stageReports;
+    PerfReading eventTotals;                  // whole run, when options.countEvents
+    std::vector<TraceBuffer*> traces;         // one per worker, null when not tracing
+    TraceBuffer* mainTrace = nullptr;         // the constructing thread
+    
+    bool chunked = false;                     // checkpointed or streaming to a trial sink
+    std::vector<TrialRecord> pending;         // the current chunk, by trial - pendingFirst
+    int pendingFirst = 0;
+    int completedTrials = 0;
+    int resumedTrials = 0;                    // trials already done in the checkpoint resumed from
+    
+    // Hand-off between the generator and one solver: permutation buffers
+    // travel generator -> solver on ready and come back on free.
+    struct PipelineQueues {
+        RingBuffer<int> ready;
+        RingBuffer<int> free;
+        std::vector<std::vector<int>> buffers;   // site orders, one per slot
+        std::vector<int> slotTrial;              // trial index carried by each slot
+        std::vector<int> slotShuffled;           // leading entries of the order already drawn
+        std::vector<uint64_t> slotSeed;          // seed for drawing the rest, if the trial gets there
+        
+        explicit PipelineQueues(int depth)
+            : ready(depth + 1), free(depth), buffers(depth), slotTrial(depth), slotShuffled(depth), slotSeed(depth) {}
+    };
+    
+    // Forward Fisher-Yates steps [from, to) of a site order: each step
+    // draws the next site uniformly from those not yet drawn, so a prefix
+    // is finished on its own and the rest can be drawn later, by anyone
+    static void shuffleSteps(std::vector<int>& order, int from, int to, Xoshiro256& gen) {
+        uint32_t sites = uint32_t(order.size());
+        for (int i = from; i < to; i++) {
+            std::swap(order[i], order[i + gen.bounded(sites - uint32_t(i))]);
+        }
+    }
+    
+    // Entries the generator draws per trial: a trial percolates after about
+    // 59% of n^2 opens, so two thirds (plus slack for small grids) covers
+    // nearly every trial and the solver draws the rest in the rare others
+    int pipelinePrefix() const {
+        long long sites = (long long)n * n;
+        return int(std::min(sites, sites * 2 / 3 + 64));
+    }
     
+    // Merge worker tallies in worker order, so the result does not
+    // depend on which thread finished first
     void calculateStats() {
-        // Calculate mean
-        double sum = 0.0;
-        for (double threshold : thresholds) {
-            sum += threshold;
+        TraceSpan span(mainTrace, "merge", "stats");
+        for (const auto& partial : partials) {
+            summary.merge(partial);
+        }
+    }
+    
+    // Record a finished (just percolated) trial on the worker's own tally;
+    // the cluster figures are read off the engine's running counters
+    void record(TrialTally& local, int trial, Percolation& perc) {
+        double sites = double(n) * n;
+        double threshold = perc.numberOfOpenSites() / sites;
+        double clusterSize = perc.meanClusterSize();
+        double strength = perc.spanningClusterSize() / sites;
+        if (chunked) {
+            // Added to the summary in trial order once the whole chunk is done
+            TrialRecord& result = pending[trial - pendingFirst];
+            result.openSites = perc.numberOfOpenSites();
+            result.meanClusterSize = clusterSize;
+            result.spanningStrength = strength;
+        } else {
+            local.add(threshold, clusterSize, strength);
+        }
+        if (options.retainThresholds) {
+            thresholds[trial] = threshold;
+        }
+    }
+    
+    // Trials [first, first + count) advanced `lanes` at a time, one open per
+    // trial per step. Each trial's next site is drawn and prefetched a full
+    // round before it is opened, so the lanes' cache misses overlap.
+    void runInterleaved(int worker, int first, int count, unsigned int seed, int lanes) {
+        Stopwatch sw;
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<> dis(0, n - 1);
+        
+        struct Lane {
+            int trial;        // trial in progress (-1 once the lane has drained)
+            int row, col;     // site drawn for the next step
+        };
+        TrialTally local(options.sketchAccuracy);
+        std::vector<Percolation> grids;
+        std::vector<Lane> state(lanes);
+        grids.reserve(lanes);
+        
+        int nextTrial = first;
+        int active = 0;
+        auto startTrial = [&](int k) {
+            Lane& lane = state[k];
+            if (nextTrial == first + count) {
+                lane.trial = -1;
+                return;
+            }
+            if (int(grids.size()) <= k) {
+                grids.emplace_back(n);
+            } else {
+                grids[k].reset();
+            }
+            lane.trial = nextTrial++;
+            lane.row = dis(gen);
+            lane.col = dis(gen);
+            grids[k].prefetch(lane.row, lane.col);
+            active++;
+        };
+        for (int k = 0; k < lanes; k++) {
+            startTrial(k);
+        }
+        
+        // Lanes overlap in time, so the whole slice is one span
+        TraceSpan batch(traces[worker], "batch", "trial", count);
+        while (active > 0) {
+            for (int k = 0; k < lanes; k++) {
+                Lane& lane = state[k];
+                if (lane.trial < 0) continue;
+                Percolation& perc = grids[k];
+                
+                // An already open draw is simply rejected and redrawn next round
+                if (!perc.isOpen(lane.row, lane.col)) {
+                    perc.open(lane.row, lane.col);
+                } else {
+                    PERCOLATION_COUNT(local.engine.rejectedDraws++);
+                }
+                
+                if (perc.percolates()) {
+                    record(local, lane.trial, perc);
+                    active--;
+                    startTrial(k);
+                } else {
+                    lane.row = dis(gen);
+                    lane.col = dis(gen);
+                    perc.prefetch(lane.row, lane.col);
+                }
+            }
+        }
+
+#ifdef PERCOLATION_COUNTERS
+        for (const auto& grid : grids) {
+            local.engine.merge(grid.counters());
+        }
+#endif
+        partials[worker] = local;
+        workerReports[worker].trials = count;
+        workerReports[worker].seconds = sw.elapsedTime();
+    }
+    
+    // One trial on a reused grid; draw() returns a random row or column.
+    // Lap is PhaseLap for a timed trial and NoPhaseLap otherwise, so untimed
+    // trials carry no timing code at all.
+    template <typename Lap, typename Draw>
+    void runTrial(int t, Percolation& perc, Draw& draw, TrialTally& local, Lap& lap) {
+        perc.reset();
+        lap.mark(PHASE_INIT);
+        
+        // Keep opening sites until system percolates
+        while (!perc.percolates()) {
+            lap.mark(PHASE_CHECK);
+            int row, col;
+            // Find a blocked site to open
+            row = draw();
+            col = draw();
+            while (perc.isOpen(row, col)) {
+                PERCOLATION_COUNT(local.engine.rejectedDraws++);
+                row = draw();
+                col = draw();
+            }
+            lap.mark(PHASE_RNG);
+            
+            perc.open(row, col);
+            lap.mark(PHASE_OPEN);
+        }
+        lap.mark(PHASE_CHECK);
+        
+        // Calculate and record threshold for this trial
+        record(local, t, perc);
+        lap.mark(PHASE_STATS);
+    }
+    
+    // Trials [first, first + count) on one worker. The grid and generator are
+    // created here so their memory is first touched by the worker's thread.
+    // With options.phaseTiming, every phaseSampleEvery-th trial is timed.
+    void runWorker(int worker, int first, int count, unsigned int seed) {
+        Stopwatch sw;
+        Percolation perc(n);
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<> dis(0, n - 1);
+        auto draw = [&]() { return dis(gen); };
+        TrialTally local(options.sketchAccuracy);
+        
+        for (int t = first; t < first + count; t++) {
+            TraceSpan span(traces[worker], "trial", "trial", t);
+            if (options.phaseTiming && t % options.phaseSampleEvery == 0) {
+                PhaseLap lap(local.phases);
+                runTrial(t, perc, draw, local, lap);
+            } else {
+                NoPhaseLap lap;
+                runTrial(t, perc, draw, local, lap);
+            }
         }
-        sampleMean = sum / trials;
         
-        // Calculate standard deviation
-        double sumSquaredDiffs = 0.0;
-        for (double threshold : thresholds) {
-            double diff = threshold - sampleMean;
-            sumSquaredDiffs += diff * diff;
+        PERCOLATION_COUNT(local.engine.merge(perc.counters()));
+        partials[worker] = local;
+        workerReports[worker].trials = count;
+        workerReports[worker].seconds = sw.elapsedTime();
+    }
+    
+    // Trials [first, first + count) of one chunk of a chunked run
+    void runSeededSlice(int worker, int first, int count, uint64_t runSeed) {
+        Stopwatch sw;
+        Percolation perc(n);
+        TrialTally local(options.sketchAccuracy);
+        
+        for (int t = first; t < first + count; t++) {
+            TraceSpan span(traces[worker], "trial", "trial", t);
+            uint64_t seed = trialSeed(runSeed, t);
+            pending[t - pendingFirst].trial = uint64_t(t);
+            pending[t - pendingFirst].seed = seed;
+            Xoshiro256 gen(seed);
+            auto draw = [&]() { return int(gen.bounded(uint32_t(n))); };
+            if (options.phaseTiming && t % options.phaseSampleEvery == 0) {
+                PhaseLap lap(local.phases);
+                runTrial(t, perc, draw, local, lap);
+            } else {
+                NoPhaseLap lap;
+                runTrial(t, perc, draw, local, lap);
+            }
+        }
+        
+        PERCOLATION_COUNT(local.engine.merge(perc.counters()));
+        partials[worker].merge(local);
+        workerReports[worker].trials += count;
+        workerReports[worker].seconds += sw.elapsedTime();
+    }
+    
+    // Checkpoint file: magic, the run's shape and seed, the next trial to
+    // run, the summary of every trial before it, then the trial sink's state
+    void saveCheckpoint(uint64_t runSeed, int nextTrial) {
+        TraceSpan span(mainTrace, "checkpoint", "io", nextTrial);
+        std::ostringstream out;
+        out.write("PERCCKP1", 8);
+        BinaryIO::write(out, n);
+        BinaryIO::write(out, trials);
+        BinaryIO::write(out, options.checkpointChunk);
+        BinaryIO::write(out, runSeed);
+        BinaryIO::write(out, nextTrial);
+        summary.save(out);
+        BinaryIO::write(out, uint8_t(options.trialSink != nullptr));
+        if (options.trialSink) options.trialSink->saveState(out);
+        BinaryIO::replaceFile(options.checkpointPath, out.str());
+    }
+    
+    // false when there is no checkpoint yet; throws if it belongs to another run.
+    // The trial sink drops whatever it wrote after the checkpoint
+    bool loadCheckpoint(uint64_t& runSeed, int& nextTrial) {
+        const std::string& path = options.checkpointPath;
+        std::string bytes;
+        if (!BinaryIO::readFile(path, bytes)) return false;
+        
+        std::istringstream in(bytes);
+        char magic[8];
+        if (!in.read(magic, 8) || std::string(magic, 8) != "PERCCKP1") {
+            throw std::runtime_error("Not a PercolationStats checkpoint: " + path);
+        }
+        int savedN = BinaryIO::read<int>(in);
+        int savedTrials = BinaryIO::read<int>(in);
+        int savedChunk = BinaryIO::read<int>(in);
+        uint64_t savedSeed = BinaryIO::read<uint64_t>(in);
+        int savedNext = BinaryIO::read<int>(in);
+        if (savedN != n || savedTrials != trials || savedChunk != options.checkpointChunk) {
+            throw std::invalid_argument("Checkpoint " + path + " is for a different grid size, trial count or chunk size");
+        }
+        if (options.seed != 0 && savedSeed != options.seed) {
+            throw std::invalid_argument("Checkpoint " + path + " was written with a different seed");
+        }
+        if (savedNext < 0 || savedNext > trials) {
+            throw std::runtime_error("Corrupt checkpoint: " + path);
+        }
+        summary.load(in);
+        if (in.peek() != EOF && BinaryIO::read<uint8_t>(in) != 0 && options.trialSink) {
+            options.trialSink->restoreState(in);
+        }
+        runSeed = savedSeed;
+        nextTrial = savedNext;
+        return true;
+    }
+    
+    // Chunked trial loop with periodic checkpoints. Each chunk is split over
+    // the workers and its results are added to the summary (and handed to
+    // the trial sink) in trial order, so the statistics depend neither on the
+    // thread count nor on whether or where the run was interrupted and resumed.
+    void runChunked(WorkerPool& pool, uint64_t runSeed) {
+        int next = 0;
+        if (options.resume && !options.checkpointPath.empty() && loadCheckpoint(runSeed, next)) {
+            resumedTrials = next;
+        }
+        if (options.trialSink) options.trialSink->begin(n, trials, runSeed);
+        if (!options.checkpointPath.empty() && resumedTrials == 0) {
+            // A run killed before its first timed checkpoint resumes from here,
+            // with its seed and with the sinks cut back to where they started
+            saveCheckpoint(runSeed, 0);
+        }
+        int stop = options.trialBudget > 0 ? int(std::min<long long>(trials, (long long)next + options.trialBudget)) : trials;
+        int chunk = options.checkpointChunk;
+        pending.resize(std::min(chunk, trials));
+        
+        Stopwatch sinceCheckpoint;
+        while (next < stop) {
+            int count = std::min(chunk, trials - next);
+            pendingFirst = next;
+            pool.run([&](int worker) {
+                int first = next + int((long long)count * worker / options.threads);
+                int last = next + int((long long)count * (worker + 1) / options.threads);
+                runSeededSlice(worker, first, last - first, runSeed);
+            });
+            double sites = double(n) * n;
+            for (int i = 0; i < count; i++) {
+                summary.add(pending[i].openSites / sites, pending[i].meanClusterSize, pending[i].spanningStrength);
+            }
+            if (options.trialSink) {
+                TraceSpan span(mainTrace, "sink", "io", next);
+                options.trialSink->write(pending.data(), size_t(count));
+            }
+            next += count;
+            bool last = next >= stop;
+            if (!options.checkpointPath.empty() && (last || sinceCheckpoint.elapsedTime() >= options.checkpointSeconds)) {
+                // Trials the checkpoint counts as done must be out of the sink first
+                if (options.trialSink) options.trialSink->flush();
+                saveCheckpoint(runSeed, next);
+                sinceCheckpoint.reset();
+            }
+        }
+        if (options.trialSink) options.trialSink->flush();
+        completedTrials = next;
+    }
+    
+    // Generator stage: draws the likely-used prefix of a fresh site order into
+    // whichever solver has a free buffer, then tells every solver to stop with slot -1
+    void runGenerator(std::vector<std::unique_ptr<PipelineQueues>>& queues, uint64_t seed, StageReport& report) {
+        Stopwatch total;
+        Xoshiro256 gen(seed);
+        double stall = 0.0;
+        double depthSum = 0.0;
+        size_t solvers = queues.size();
+        size_t next = 0;
+        int prefix = pipelinePrefix();
+        
+        for (int t = 0; t < trials; t++) {
+            // Find a solver with a free buffer, waiting only if none has one
+            int slot = -1;
+            size_t s = next;
+            for (size_t tries = 0; slot < 0 && tries < solvers; tries++, s = (s + 1) % solvers) {
+                if (queues[s]->free.tryPop(slot)) break;
+            }
+            if (slot < 0) {
+                TraceSpan span(traces[0], "stall", "wait");
+                Stopwatch wait;
+                for (s = next; !queues[s]->free.tryPop(slot); s = (s + 1) % solvers) {
+                    std::this_thread::yield();
+                }
+                stall += wait.elapsedTime();
+            }
+            next = (s + 1) % solvers;
+            
+            // Fisher-Yates over the previous order is as good as over the identity
+            TraceSpan span(traces[0], "shuffle", "generate", t);
+            PipelineQueues& q = *queues[s];
+            shuffleSteps(q.buffers[slot], 0, prefix, gen);
+            q.slotTrial[slot] = t;
+            q.slotShuffled[slot] = prefix;
+            q.slotSeed[slot] = gen();
+            depthSum += q.ready.sizeApprox();
+            q.ready.tryPush(slot);
+        }
+        
+        for (auto& q : queues) {
+            while (!q->ready.tryPush(-1)) {
+                std::this_thread::yield();
+            }
+        }
+        
+        double elapsed = total.elapsedTime();
+        report = StageReport{"generator", trials, elapsed - stall, stall, depthSum / trials};
+    }
+    
+    // Solver stage: opens sites in the order handed over until the grid percolates
+    void runSolver(int worker, PipelineQueues& q, StageReport& report) {
+        Stopwatch total;
+        Percolation perc(n);
+        TrialTally local(options.sketchAccuracy);
+        double stall = 0.0;
+        double depthSum = 0.0;
+        int consumed = 0;
+        
+        // Buffers are allocated here so they live on this solver's node
+        for (int slot = 0; slot < int(q.buffers.size()); slot++) {
+            q.buffers[slot].resize(n * n);
+            std::iota(q.buffers[slot].begin(), q.buffers[slot].end(), 0);
+            q.free.tryPush(slot);
+        }
+        
+        while (true) {
+            int slot;
+            if (!q.ready.tryPop(slot)) {
+                TraceSpan span(traces[worker], "stall", "wait");
+                Stopwatch wait;
+                while (!q.ready.tryPop(slot)) {
+                    std::this_thread::yield();
+                }
+                stall += wait.elapsedTime();
+            }
+            if (slot < 0) break;
+            depthSum += q.ready.sizeApprox();
+            
+            TraceSpan span(traces[worker], "trial", "trial", q.slotTrial[slot]);
+            perc.reset();
+            std::vector<int>& order = q.buffers[slot];
+            for (int i = 0; !perc.percolates(); i++) {
+                if (i == q.slotShuffled[slot]) {
+                    Xoshiro256 rest(q.slotSeed[slot]);
+                    shuffleSteps(order, i, int(order.size()), rest);
+                }
+                perc.open(order[i] / n, order[i] % n);
+            }
+            record(local, q.slotTrial[slot], perc);
+            consumed++;
+            
+            q.free.tryPush(slot);
         }
-        sampleStddev = std::sqrt(sumSquaredDiffs / (trials - 1));
+        
+        double elapsed = total.elapsedTime();
+        PERCOLATION_COUNT(local.engine.merge(perc.counters()));
+        partials[worker] = local;
+        workerReports[worker].trials = consumed;
+        workerReports[worker].seconds = elapsed;
+        report = StageReport{"solver " + std::to_string(worker - 1), consumed, elapsed - stall, stall,
+                             consumed > 0 ? depthSum / consumed : 0.0};
     }
 
 public:
     // perform independent trials on an n-by-n grid
-    PercolationStats(int n, int trials) {
+    PercolationStats(int n, int trials) : PercolationStats(n, trials, StatsOptions()) {}
+    
+    // perform independent trials on an n-by-n grid, split over worker threads
+    PercolationStats(int n, int trials, const StatsOptions& options) {
         if (n <= 0) {
             throw std::invalid_argument("Grid size n must be positive");
         }
         if (trials <= 0) {
             throw std::invalid_argument("Number of trials must be positive");
         }
+        if (options.threads <= 0) {
+            throw std::invalid_argument("Number of threads must be positive");
+        }
+        if (options.pipelined && options.pipelineDepth <= 0) {
+            throw std::invalid_argument("Pipeline depth must be positive");
+        }
+        if (options.interleave <= 0) {
+            throw std::invalid_argument("Interleave factor must be positive");
+        }
+        if (options.pipelined && options.interleave > 1) {
+            throw std::invalid_argument("Pipelined runs cannot be interleaved");
+        }
+        if (options.phaseSampleEvery <= 0) {
+            throw std::invalid_argument("Phase sampling interval must be positive");
+        }
+        if ((!options.checkpointPath.empty() || options.trialSink)
+            && (options.pipelined || options.interleave > 1 || options.retainThresholds)) {
+            throw std::invalid_argument("Checkpointed and trial-sink runs use the plain worker loop and keep no per-trial thresholds");
+        }
+        if (options.checkpointChunk <= 0 || options.checkpointSeconds < 0 || options.trialBudget < 0) {
+            throw std::invalid_argument("Checkpoint chunk must be positive, interval and trial budget non-negative");
+        }
+        if ((options.resume || options.trialBudget > 0) && options.checkpointPath.empty()) {
+            throw std::invalid_argument("Resuming and trial budgets need a checkpoint path");
+        }
         
         this->n = n;
         this->trials = trials;
-        thresholds.reserve(trials);
+        this->options = options;
+        chunked = !options.checkpointPath.empty() || options.trialSink;
+        completedTrials = trials;
+        if (options.retainThresholds) {
+            thresholds.resize(trials);
+        }
         
-        // Random number generation
+        // Pipelined runs add a generator thread in front of the workers
+        int poolSize = options.pipelined ? options.threads + 1 : options.threads;
+        
+        // Seeds are drawn up front; each worker builds its own generator
         std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, n - 1);
+        SplitMix64 fixed(options.seed);
+        std::vector<unsigned int> seeds(poolSize);
+        for (auto& seed : seeds) {
+            seed = options.seed != 0 ? (unsigned int)fixed.next() : rd();
+        }
+        uint64_t generatorSeed = options.seed != 0 ? fixed.next() : ((uint64_t)seeds[0] << 32) | rd();
+        uint64_t runSeed = options.seed != 0 ? options.seed : generatorSeed;
         
-        // Perform trials
-        for (int t = 0; t < trials; t++) {
-            Percolation perc(n);
-            
-            // Keep opening sites until system percolates
-            while (!perc.percolates()) {
-                int row, col;
-                // Find a blocked site to open
-                do {
-                    row = dis(gen);
-                    col = dis(gen);
-                } while (perc.isOpen(row, col));
-                
-                perc.open(row, col);
+        // Counters inherit into the worker threads the pool starts below
+        std::unique_ptr<PerfCounters> counters;
+        if (options.countEvents) {
+            counters.reset(new PerfCounters());
+            counters->start();
+        }
+        
+        // Trace buffers are registered here, so workers never take the tracer's lock
+        traces.assign(poolSize, nullptr);
+        if (options.tracer) {
+            mainTrace = options.tracer->thread("stats main");
+            for (int w = 0; w < poolSize; w++) {
+                bool generator = options.pipelined && w == 0;
+                traces[w] = options.tracer->thread(generator ? std::string("generator")
+                                                             : "worker " + std::to_string(options.pipelined ? w - 1 : w));
             }
-            
-            // Calculate and store threshold for this trial
-            double threshold = static_cast<double>(perc.numberOfOpenSites()) / (n * n);
-            thresholds.push_back(threshold);
+        }
+        TraceSpan run(mainTrace, "PercolationStats", "stats", trials);
+        
+        WorkerPool pool(poolSize, options.pinThreads);
+        workerReports.assign(poolSize, WorkerReport{-1, 0, 0, 0.0});
+        summary = TrialTally(options.sketchAccuracy);
+        partials.assign(poolSize, TrialTally(options.sketchAccuracy));
+        if (options.pipelined) {
+            // Worker 0 generates site orders, workers 1..threads consume them
+            std::vector<std::unique_ptr<PipelineQueues>> queues;
+            for (int s = 0; s < options.threads; s++) {
+                queues.emplace_back(new PipelineQueues(options.pipelineDepth));
+            }
+            stageReports.resize(poolSize);
+            pool.run([&](int worker) {
+                if (worker == 0) {
+                    runGenerator(queues, generatorSeed, stageReports[0]);
+                } else {
+                    runSolver(worker, *queues[worker - 1], stageReports[worker]);
+                }
+            });
+        } else if (chunked) {
+            runChunked(pool, runSeed);
+        } else {
+            // Perform trials, each worker taking a contiguous slice
+            pool.run([&](int worker) {
+                int first = int((long long)trials * worker / options.threads);
+                int last = int((long long)trials * (worker + 1) / options.threads);
+                if (options.interleave > 1) {
+                    runInterleaved(worker, first, last - first, seeds[worker], options.interleave);
+                } else {
+                    runWorker(worker, first, last - first, seeds[worker]);
+                }
+            });
+        }
+        for (int w = 0; w < poolSize; w++) {
+            workerReports[w].cpu = pool.cpuOf(w);
+            workerReports[w].node = pool.nodeOf(w);
+        }
+        if (counters) {
+            counters->stop();
+            eventTotals = counters->read();
         }
         
         // Calculate statistics
@@ -77,24 +700,174 @@ public:
     
     // sample mean of percolation threshold
     double mean() {
-        return sampleMean;
+        return summary.stats.mean();
     }
     
     // sample standard deviation of percolation threshold
     double stddev() {
-        return sampleStddev;
+        return summary.stats.stddev();
     }
     
     // low endpoint of 95% confidence interval
     double confidenceLow() {
-        double margin = 1.96 * sampleStddev / std::sqrt(trials);
-        return sampleMean - margin;
+        double margin = 1.96 * summary.stats.stddev() / std::sqrt(double(summary.stats.size()));
+        return summary.stats.mean() - margin;
     }
     
     // high endpoint of 95% confidence interval
     double confidenceHigh() {
-        double margin = 1.96 * sampleStddev / std::sqrt(trials);
-        return sampleMean + margin;
+        double margin = 1.96 * summary.stats.stddev() / std::sqrt(double(summary.stats.size()));
+        return summary.stats.mean() + margin;
+    }
+    
+    // trials covered by the statistics; fewer than requested when a
+    // checkpointed run stopped at its trial budget
+    int trialsCompleted() const {
+        return completedTrials;
+    }
+    
+    // Seed of trial t in a checkpointed or trial-sink run: a function of the
+    // run seed and t alone, so a trial draws the same sites on any worker, in
+    // any process, and when replayed on its own from a recorded seed
+    static uint64_t trialSeed(uint64_t runSeed, int t) {
+        return SplitMix64(runSeed + uint64_t(t) * 0x9e3779b97f4a7c15ULL).next();
+    }
+    
+    // trials a resumed run found already done in its checkpoint (0 if it started fresh)
+    int trialsResumed() const {
+        return resumedTrials;
+    }
+    
+    // trials this process ran: what the counters, phase times and hardware
+    // events cover, unlike the statistics, which include resumed trials
+    int trialsRun() const {
+        return completedTrials - resumedTrials;
+    }
+    
+    // mergeable summary of every trial's threshold
+    const StatsAccumulator& accumulator() const {
+        return summary.stats;
+    }
+    
+    // mean cluster size (largest cluster excluded) at the threshold, averaged over trials
+    double meanClusterSize() const {
+        return summary.clusterSize.mean();
+    }
+    
+    // strength of the spanning cluster at the threshold: its sites / n^2, averaged over trials
+    double spanningStrength() const {
+        return summary.strength.mean();
+    }
+    
+    // mergeable sketch of the threshold distribution
+    const QuantileSketch& sketch() const {
+        return summary.quantiles;
+    }
+    
+    // estimated q-quantile of the threshold, e.g. quantile(0.5) for the median
+    double quantile(double q) const {
+        return summary.quantiles.quantile(q);
+    }
+    
+    // equal-width histogram of the threshold with estimated counts
+    std::vector<HistogramBin> histogram(int bins) const {
+        return summary.quantiles.histogram(bins);
+    }
+    
+    // per-trial thresholds in trial order (empty unless options.retainThresholds)
+    const std::vector<double>& samples() const {
+        return thresholds;
+    }
+    
+    // Bootstrap percentile and BCa intervals for the mean threshold, resampled
+    // on options.threads workers; needs options.retainThresholds. A seeded
+    // run resamples from a seed of its own, so the intervals repeat too
+    BootstrapInterval bootstrap(int replicates = 1000, double confidence = 0.95) const {
+        if (!options.retainThresholds) {
+            throw std::logic_error("Bootstrap needs StatsOptions::retainThresholds");
+        }
+        if (options.seed != 0) {
+            uint64_t resampleSeed = SplitMix64(options.seed ^ 0x626f6f7473747261ULL).next();
+            return Bootstrap::meanInterval(thresholds, replicates, confidence, options.threads, resampleSeed);
+        }
+        return Bootstrap::meanInterval(thresholds, replicates, confidence, options.threads);
+    }
+    
+    // per-worker breakdown of the run
+    const std::vector<WorkerReport>& workers() const {
+        return workerReports;
+    }
+
+#ifdef PERCOLATION_COUNTERS
+    // engine work of the trialsRun() trials in this process: find paths, unions, rejected draws
+    const EngineCounters& engineCounters() const {
+        return summary.engine;
+    }
+
+#endif
+    // time per trial phase summed over the sampled trials of every worker
+    // (options.phaseTiming with the plain worker loop; empty otherwise)
+    const PhaseTimes& phaseTimes() const {
+        return summary.phases;
+    }
+    
+    // phase breakdown scaled from the sampled trials up to the whole run
+    void printPhaseTimes(std::ostream& out) const {
+        long long sampled = summary.phases.count(PHASE_STATS);
+        if (sampled == 0) {
+            out << "  no trials timed\n";
+            return;
+        }
+        int run = trialsRun();
+        out << "  (" << sampled << " of " << run << " trials timed, scaled to all)\n";
+        summary.phases.print(out, double(run) / double(sampled));
+    }
+    
+    // hardware counters per trial (options.countEvents; nothing counted otherwise)
+    PerfReading eventsPerTrial() const {
+        return eventTotals.per(double(std::max(trialsRun(), 1)));
+    }
+    
+    // per-stage occupancy of a pipelined run (empty otherwise)
+    const std::vector<StageReport>& stages() const {
+        return stageReports;
+    }
+    
+    // busy/stall split and queue depth of every pipeline stage
+    void printPipelineReport(std::ostream& out) const {
+        out << std::setw(12) << "stage" << std::setw(10) << "items"
+            << std::setw(10) << "busy %" << std::setw(10) << "stall %"
+            << std::setw(12) << "mean depth\n";
+        for (const auto& stage : stageReports) {
+            double total = stage.busySeconds + stage.stallSeconds;
+            out << std::setw(12) << stage.stage
+                << std::setw(10) << stage.items
+                << std::setw(10) << (total > 0 ? 100.0 * stage.busySeconds / total : 0.0)
+                << std::setw(10) << (total > 0 ? 100.0 * stage.stallSeconds / total : 0.0)
+                << std::setw(12) << stage.meanQueueDepth << '\n';
+        }
+    }
+    
+    // trials per second achieved on each NUMA node
+    void printNodeThroughput(std::ostream& out) const {
+        std::map<int, std::pair<int, double>> perNode;   // node -> (trials, max worker seconds)
+        std::map<int, int> workersPerNode;
+        for (const auto& report : workerReports) {
+            auto& entry = perNode[report.node];
+            entry.first += report.trials;
+            entry.second = std::max(entry.second, report.seconds);
+            workersPerNode[report.node]++;
+        }
+        
+        out << std::setw(6) << "node" << std::setw(10) << "workers"
+            << std::setw(10) << "trials" << std::setw(16) << "trials/s\n";
+        for (const auto& entry : perNode) {
+            double seconds = entry.second.second;
+            out << std::setw(6) << entry.first
+                << std::setw(10) << workersPerNode[entry.first]
+                << std::setw(10) << entry.second.first
+                << std::setw(16) << (seconds > 0 ? entry.second.first / seconds : 0.0) << '\n';
+        }
     }
     
     // test client
@@ -114,7 +887,170 @@ public:
         std::cout << "95% confidence interval: [" << stats.confidenceLow() 
                   << ", " << stats.confidenceHigh() << "]" << std::endl;
         
+        // The spanning cluster holds some, never more than all, of the open sites
+        std::cout << "Spanning strength in (0, mean]: "
+                  << (stats.spanningStrength() > 0 && stats.spanningStrength() <= stats.mean() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        std::cout << "Mean cluster size at threshold >= 1: " << (stats.meanClusterSize() >= 1.0 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // Multithreaded run must account for every trial
+        StatsOptions threaded;
+        threaded.threads = 3;
+        threaded.pinThreads = true;
+        PercolationStats threadedStats(testN, testTrials, threaded);
+        int completed = 0;
+        for (const auto& report : threadedStats.workers()) {
+            completed += report.trials;
+        }
+        std::cout << "Trials completed by 3 workers: " << completed << " (expected: " << testTrials << ")" << std::endl;
+        
+        // Pipelined run: the generator must produce exactly what the solvers consume
+        StatsOptions pipelined;
+        pipelined.threads = 2;
+        pipelined.pipelined = true;
+        PercolationStats pipelinedStats(testN, testTrials, pipelined);
+        int consumed = 0;
+        for (size_t s = 1; s < pipelinedStats.stages().size(); s++) {
+            consumed += pipelinedStats.stages()[s].items;
+        }
+        std::cout << "Pipelined: produced " << pipelinedStats.stages()[0].items << ", consumed " << consumed
+                  << " (expected: " << testTrials << ", " << testTrials << ")" << std::endl;
+        std::cout << "Pipelined mean in (0, 1): " << (pipelinedStats.mean() > 0 && pipelinedStats.mean() < 1 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // Interleaved run: more lanes than trials must still finish every trial
+        StatsOptions interleaved;
+        interleaved.interleave = 4;
+        PercolationStats interleavedStats(testN, 3, interleaved);
+        std::cout << "Interleaved trials completed: " << interleavedStats.workers()[0].trials << " (expected: 3)" << std::endl;
+        std::cout << "Interleaved mean in (0, 1): " << (interleavedStats.mean() > 0 && interleavedStats.mean() < 1 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // Retained thresholds must agree with the streaming summary
+        StatsOptions retained;
+        retained.threads = 2;
+        retained.retainThresholds = true;
+        PercolationStats retainedStats(testN, testTrials, retained);
+        StatsAccumulator check;
+        for (double threshold : retainedStats.samples()) {
+            check.add(threshold);
+        }
+        std::cout << "Retained thresholds: " << retainedStats.samples().size() << " (expected: " << testTrials << ")" << std::endl;
+        std::cout << "Streaming mean matches retained: " << (std::fabs(check.mean() - retainedStats.mean()) < 1e-12 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        std::cout << "Sketched median within retained range: "
+                  << (retainedStats.quantile(0.5) >= check.min() && retainedStats.quantile(0.5) <= check.max() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        BootstrapInterval interval = retainedStats.bootstrap(200);
+        std::cout << "Bootstrap BCa interval contains mean: "
+                  << (interval.bcaLow <= retainedStats.mean() && retainedStats.mean() <= interval.bcaHigh ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        StatsOptions seededRetained = retained;
+        seededRetained.seed = 11;
+        PercolationStats seededA(testN, testTrials, seededRetained);
+        PercolationStats seededB(testN, testTrials, seededRetained);
+        BootstrapInterval once = seededA.bootstrap(200), again = seededB.bootstrap(200);
+        std::cout << "Seeded bootstrap repeats: " << (once.bcaLow == again.bcaLow && once.bcaHigh == again.bcaHigh ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        // A checkpointed run stopped part way and resumed on another thread
+        // count must end with exactly the statistics of an uninterrupted run
+        std::string path = "percolation_test.ckpt";
+        std::remove(path.c_str());
+        StatsOptions whole;
+        whole.seed = 7;
+        whole.checkpointPath = path;
+        whole.checkpointChunk = 8;
+        whole.checkpointSeconds = 0.0;
+        PercolationStats uninterrupted(testN, testTrials, whole);
+        std::remove(path.c_str());
+        StatsOptions first = whole;
+        first.threads = 2;
+        first.trialBudget = 20;
+        PercolationStats stopped(testN, testTrials, first);
+        StatsOptions second = whole;
+        second.threads = 3;
+        second.resume = true;
+        PercolationStats resumed(testN, testTrials, second);
+        std::remove(path.c_str());
+        std::cout << "Stopped after trials: " << stopped.trialsCompleted() << " (expected: 24)" << std::endl;
+        std::cout << "Resumed from trial: " << resumed.trialsResumed() << " (expected: 24)" << std::endl;
+        std::cout << "Trials run after resuming: " << resumed.trialsRun() << " (expected: 6)" << std::endl;
+        std::cout << "Resumed run matches uninterrupted: "
+                  << (resumed.mean() == uninterrupted.mean() && resumed.stddev() == uninterrupted.stddev()
+                      && resumed.quantile(0.5) == uninterrupted.quantile(0.5) ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // A trial sink sees every trial once, in order, with its own seed
+        struct CollectingSink : TrialSink {
+            std::vector<TrialRecord> records;
+            void write(const TrialRecord* batch, size_t count) override {
+                records.insert(records.end(), batch, batch + count);
+            }
+        } sink;
+        StatsOptions streamed;
+        streamed.threads = 2;
+        streamed.seed = 7;
+        streamed.checkpointChunk = 8;
+        streamed.trialSink = &sink;
+        PercolationStats streamedStats(testN, testTrials, streamed);
+        bool ordered = sink.records.size() == size_t(testTrials);
+        StatsAccumulator sunk;
+        for (size_t i = 0; ordered && i < sink.records.size(); i++) {
+            ordered = sink.records[i].trial == i && sink.records[i].seed == trialSeed(7, int(i));
+            sunk.add(sink.records[i].openSites / double(testN * testN));
+        }
+        std::cout << "Sink received every trial in order: " << (ordered ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Sink matches checkpointed run: " << (sunk.mean() == streamedStats.mean()
+                                                          && streamedStats.mean() == uninterrupted.mean() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // Trials a killed run sank after its last checkpoint are dropped on resume, not repeated
+        struct RewindingSink : TrialSink {
+            std::vector<TrialRecord> records;
+            void write(const TrialRecord* batch, size_t count) override {
+                records.insert(records.end(), batch, batch + count);
+            }
+            void saveState(std::ostream& out) override {
+                BinaryIO::write(out, uint64_t(records.size()));
+            }
+            void restoreState(std::istream& in) override {
+                records.resize(size_t(BinaryIO::read<uint64_t>(in)));
+            }
+        } rewinding;
+        StatsOptions sinkFirst = first;
+        sinkFirst.trialSink = &rewinding;
+        PercolationStats sinkStopped(testN, testTrials, sinkFirst);
+        rewinding.records.push_back(rewinding.records.back());
+        StatsOptions sinkSecond = second;
+        sinkSecond.trialSink = &rewinding;
+        PercolationStats sinkResumed(testN, testTrials, sinkSecond);
+        std::remove(path.c_str());
+        bool exactlyOnce = rewinding.records.size() == size_t(testTrials);
+        for (size_t i = 0; exactlyOnce && i < rewinding.records.size(); i++) {
+            exactlyOnce = rewinding.records[i].trial == i;
+        }
+        std::cout << "Resumed sink holds every trial once: " << (exactlyOnce ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        std::cout << "Thresholds dropped by default: " << (stats.samples().empty() ? "true" : "false") << " (expected: true)" << std::endl;
+        
         // Test error cases
+        try {
+            stats.bootstrap();
+            std::cout << "ERROR: Should have thrown exception for bootstrap without thresholds" << std::endl;
+        } catch (const std::logic_error& e) {
+            std::cout << "Correctly caught logic error: " << e.what() << std::endl;
+        }
+        
+        try {
+            StatsOptions badResume;
+            badResume.resume = true;
+            PercolationStats invalidStats(10, 10, badResume);
+            std::cout << "ERROR: Should have thrown exception for resume without a checkpoint path" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument for resume: " << e.what() << std::endl;
+        }
+        
         try {
             PercolationStats invalidStats(-1, 10);
             std::cout << "ERROR: Should have thrown exception for invalid n" << std::endl;
@@ -131,4 +1067,4 @@ public:
         
         std::cout << "PercolationStats tests completed." << std::endl;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,217 @@
+#pragma once
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// hardware events collected around a region
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_EVENT_COUNT
+};
+
+// counts for one region; an event the kernel refused is marked not counted
+struct PerfReading {
+    std::array<double, PERF_EVENT_COUNT> values{};
+    std::array<bool, PERF_EVENT_COUNT> counted{};
+    std::string unavailable;          // why nothing was counted, empty if something was
+    
+    bool any() const {
+        for (bool c : counted) {
+            if (c) return true;
+        }
+        return false;
+    }
+    
+    // accumulate another region's counts
+    void add(const PerfReading& other) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            values[e] += other.values[e];
+            counted[e] = counted[e] || other.counted[e];
+        }
+        if (unavailable.empty()) unavailable = other.unavailable;
+    }
+    
+    // the same reading divided by a number of trials or runs
+    PerfReading per(double count) const {
+        PerfReading result = *this;
+        for (double& value : result.values) value /= count;
+        return result;
+    }
+    
+    static const char* name(int event) {
+        static const char* names[] = {"cycles", "instr", "L1D-miss", "LLC-miss", "br-miss", "dTLB-miss"};
+        return names[event];
+    }
+    
+    // one line: every counted event, then IPC when both halves are there
+    void print(std::ostream& out) const {
+        if (!any()) {
+            out << "hardware counters unavailable" << (unavailable.empty() ? "" : " (" + unavailable + ")") << '\n';
+            return;
+        }
+        std::ios::fmtflags flags = out.flags();
+        out << std::scientific << std::setprecision(3);
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (counted[e]) out << name(e) << "=" << values[e] << "  ";
+        }
+        if (counted[PERF_CYCLES] && counted[PERF_INSTRUCTIONS] && values[PERF_CYCLES] > 0) {
+            out << std::fixed << std::setprecision(2) << "IPC=" << values[PERF_INSTRUCTIONS] / values[PERF_CYCLES];
+        }
+        out << '\n';
+        out.flags(flags);
+    }
+};
+
+// Counts hardware events for the calling thread and every thread it starts
+// while counting (inherit), so a WorkerPool run is covered as a whole.
+// Uses perf_event_open on Linux; each event is opened on its own so one the
+// PMU lacks does not lose the rest, and multiplexed counts are scaled up by
+// enabled / running time. Elsewhere, or when the kernel refuses
+// (perf_event_paranoid, containers), readings say unavailable.
+class PerfCounters {
+private:
+    std::array<int, PERF_EVENT_COUNT> fds;
+    std::string error;
+
+#if defined(__linux__)
+    static int openEvent(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    
+    static uint64_t cacheConfig(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    }
+#endif
+
+public:
+    PerfCounters() {
+        fds.fill(-1);
+#if defined(__linux__)
+        fds[PERF_CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        if (fds[PERF_CYCLES] < 0) error = std::string("perf_event_open: ") + std::strerror(errno);
+        fds[PERF_INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        fds[PERF_L1D_MISSES] = openEvent(PERF_TYPE_HW_CACHE,
+            cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        fds[PERF_LLC_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        fds[PERF_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        fds[PERF_DTLB_MISSES] = openEvent(PERF_TYPE_HW_CACHE,
+            cacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+#else
+        error = "perf_event_open needs Linux";
+#endif
+    }
+    
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+    
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    
+    // is at least one event being counted?
+    bool available() const {
+        for (int fd : fds) {
+            if (fd >= 0) return true;
+        }
+        return false;
+    }
+    
+    // zero and enable every open event
+    void start() {
+#if defined(__linux__)
+        for (int fd : fds) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    
+    // disable every event; counts stay readable
+    void stop() {
+#if defined(__linux__)
+        for (int fd : fds) {
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+    
+    // counts since start(), scaled for multiplexing
+    PerfReading read() const {
+        PerfReading reading;
+        reading.unavailable = error;
+#if defined(__linux__)
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            uint64_t data[3];                 // value, time enabled, time running
+            if (fds[e] < 0 || ::read(fds[e], data, sizeof(data)) != ssize_t(sizeof(data))) continue;
+            if (data[2] == 0) continue;
+            reading.values[e] = double(data[0]) * double(data[1]) / double(data[2]);
+            reading.counted[e] = true;
+        }
+#endif
+        return reading;
+    }
+    
+    // counts for one call of work()
+    template <typename Work>
+    static PerfReading measure(Work work) {
+        PerfCounters counters;
+        counters.start();
+        work();
+        counters.stop();
+        return counters.read();
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing PerfCounters class..." << std::endl;
+        
+        volatile uint64_t sum = 0;
+        PerfReading reading = measure([&]() {
+            for (int i = 0; i < 1000000; i++) sum = sum + i;
+        });
+        if (reading.any()) {
+            bool plausible = !reading.counted[PERF_INSTRUCTIONS] || reading.values[PERF_INSTRUCTIONS] > 1e6;
+            std::cout << "Instructions for a 1e6-iteration loop above 1e6: " << (plausible ? "true" : "false") << " (expected: true)" << std::endl;
+        } else {
+            std::cout << "Counters unavailable here, reported as: ";
+            reading.print(std::cout);
+        }
+        
+        PerfReading halved = reading.per(2.0);
+        std::cout << "per() divides every value: "
+                  << (halved.values[PERF_CYCLES] * 2.0 == reading.values[PERF_CYCLES] ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        std::cout << "PerfCounters tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,305 @@
+#pragma once
+#include "FastRandom.hpp"
+#include "BinaryIO.hpp"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+// one bin of an exported histogram
+struct HistogramBin {
+    double lower;
+    double upper;
+    double count;                     // estimated number of samples in [lower, upper)
+};
+
+// KLL quantile sketch: constant memory (about 3k doubles) whatever the
+// number of samples, rank error around 1.7/k, and mergeable across threads
+// or shards. Level h holds items that each stand for 2^h samples; when the
+// sketch is full the lowest full level is sorted and every other item is
+// promoted, starting at a random offset.
+class QuantileSketch {
+private:
+    int k;
+    std::vector<std::vector<double>> levels;
+    long long count;
+    double minimum;
+    double maximum;
+    uint64_t coins;                   // counter for the promotion offset coin
+    int bottomCapacity;               // capacity(0), cached for add()
+    
+    // Capacity shrinks by 2/3 per level below the top one
+    int capacity(int level) const {
+        int depth = int(levels.size()) - 1 - level;
+        int cap = int(std::ceil(k * std::pow(2.0 / 3.0, depth)));
+        return std::max(cap, 2);
+    }
+    
+    int totalCapacity() const {
+        int total = 0;
+        for (int h = 0; h < int(levels.size()); h++) {
+            total += capacity(h);
+        }
+        return total;
+    }
+    
+    int retained() const {
+        int total = 0;
+        for (const auto& level : levels) {
+            total += int(level.size());
+        }
+        return total;
+    }
+    
+    bool flipCoin() {
+        return SplitMix64(coins++).next() & 1;
+    }
+    
+    // Halve the lowest level that is over capacity into the level above
+    void compactOnce() {
+        for (int h = 0; h < int(levels.size()); h++) {
+            if (int(levels[h].size()) < capacity(h)) continue;
+            if (h + 1 == int(levels.size())) levels.emplace_back();
+            
+            std::vector<double>& level = levels[h];
+            std::sort(level.begin(), level.end());
+            
+            // An odd item out stays behind at this level
+            double leftover = 0.0;
+            bool odd = level.size() % 2 == 1;
+            if (odd) {
+                leftover = level.back();
+                level.pop_back();
+            }
+            
+            std::vector<double>& above = levels[h + 1];
+            for (size_t i = flipCoin() ? 1 : 0; i < level.size(); i += 2) {
+                above.push_back(level[i]);
+            }
+            level.clear();
+            if (odd) level.push_back(leftover);
+            return;
+        }
+    }
+    
+    void compress() {
+        while (retained() >= totalCapacity()) {
+            compactOnce();
+        }
+        bottomCapacity = capacity(0);
+        
+        // A level's capacity shrinks as levels are added above it; give the
+        // memory back so the sketch really stays at about 3k doubles
+        for (int h = 0; h < int(levels.size()); h++) {
+            size_t wanted = std::max(size_t(capacity(h)), levels[h].size());
+            if (levels[h].capacity() > 2 * wanted) {
+                std::vector<double> trimmed;
+                trimmed.reserve(wanted);
+                trimmed.assign(levels[h].begin(), levels[h].end());
+                levels[h].swap(trimmed);
+            }
+        }
+    }
+    
+    // every retained item with its weight, sorted by value
+    std::vector<std::pair<double, long long>> weightedItems() const {
+        std::vector<std::pair<double, long long>> items;
+        items.reserve(retained());
+        for (int h = 0; h < int(levels.size()); h++) {
+            for (double x : levels[h]) {
+                items.push_back({x, 1LL << h});
+            }
+        }
+        std::sort(items.begin(), items.end());
+        return items;
+    }
+
+public:
+    // k trades memory for accuracy; 200 keeps about 600 doubles (~10 KB allocated)
+    explicit QuantileSketch(int k = 200)
+        : k(k), levels(1), count(0),
+          minimum(std::numeric_limits<double>::infinity()),
+          maximum(-std::numeric_limits<double>::infinity()), coins(0) {
+        if (k < 8) {
+            throw std::invalid_argument("Sketch accuracy k must be at least 8");
+        }
+        bottomCapacity = capacity(0);
+    }
+    
+    // add one sample
+    void add(double x) {
+        levels[0].push_back(x);
+        count++;
+        minimum = std::min(minimum, x);
+        maximum = std::max(maximum, x);
+        if (int(levels[0].size()) >= bottomCapacity) {
+            compress();
+        }
+    }
+    
+    // fold in a sketch built over a disjoint set of samples
+    void merge(const QuantileSketch& other) {
+        if (other.count == 0) return;
+        if (other.levels.size() > levels.size()) {
+            levels.resize(other.levels.size());
+        }
+        for (size_t h = 0; h < other.levels.size(); h++) {
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        count += other.count;
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+        coins += other.coins;
+        compress();
+    }
+    
+    long long size() const { return count; }
+    
+    // Binary image of the whole sketch, coin counter included, so a restored
+    // sketch compacts exactly as the original would have
+    void save(std::ostream& out) const {
+        BinaryIO::write(out, k);
+        BinaryIO::write(out, count);
+        BinaryIO::write(out, minimum);
+        BinaryIO::write(out, maximum);
+        BinaryIO::write(out, coins);
+        BinaryIO::write(out, int(levels.size()));
+        for (const auto& level : levels) {
+            BinaryIO::write(out, int(level.size()));
+            for (double x : level) BinaryIO::write(out, x);
+        }
+    }
+    
+    void load(std::istream& in) {
+        int savedK = BinaryIO::read<int>(in);
+        if (savedK < 8) {
+            throw std::runtime_error("Corrupt quantile sketch image");
+        }
+        k = savedK;
+        count = BinaryIO::read<long long>(in);
+        minimum = BinaryIO::read<double>(in);
+        maximum = BinaryIO::read<double>(in);
+        coins = BinaryIO::read<uint64_t>(in);
+        int height = BinaryIO::read<int>(in);
+        if (height < 1 || height > 64) {
+            throw std::runtime_error("Corrupt quantile sketch image");
+        }
+        levels.assign(height, std::vector<double>());
+        for (auto& level : levels) {
+            int size = BinaryIO::read<int>(in);
+            if (size < 0 || size > count) {
+                throw std::runtime_error("Corrupt quantile sketch image");
+            }
+            level.resize(size);
+            for (double& x : level) x = BinaryIO::read<double>(in);
+        }
+        bottomCapacity = capacity(0);
+    }
+    
+    // bytes held by retained items
+    size_t memoryBytes() const {
+        size_t bytes = sizeof(*this);
+        for (const auto& level : levels) {
+            bytes += level.capacity() * sizeof(double);
+        }
+        return bytes;
+    }
+    
+    // estimated q-quantile, q in [0, 1]
+    double quantile(double q) const {
+        if (q < 0.0 || q > 1.0) {
+            throw std::invalid_argument("Quantile must be in [0, 1]");
+        }
+        if (count == 0) return std::numeric_limits<double>::quiet_NaN();
+        if (q == 0.0) return minimum;
+        if (q == 1.0) return maximum;
+        
+        std::vector<std::pair<double, long long>> items = weightedItems();
+        long long total = 0;
+        for (const auto& item : items) total += item.second;
+        
+        double target = q * total;
+        long long seen = 0;
+        for (const auto& item : items) {
+            seen += item.second;
+            if (seen >= target) return item.first;
+        }
+        return maximum;
+    }
+    
+    // equal-width histogram over [min, max] with estimated counts
+    std::vector<HistogramBin> histogram(int bins) const {
+        if (bins <= 0) {
+            throw std::invalid_argument("Number of bins must be positive");
+        }
+        
+        std::vector<HistogramBin> result;
+        if (count == 0) return result;
+        
+        double width = (maximum - minimum) / bins;
+        for (int b = 0; b < bins; b++) {
+            result.push_back(HistogramBin{minimum + b * width, minimum + (b + 1) * width, 0.0});
+        }
+        for (const auto& item : weightedItems()) {
+            int b = width > 0 ? int((item.first - minimum) / width) : 0;
+            result[std::min(b, bins - 1)].count += double(item.second);
+        }
+        return result;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing QuantileSketch class..." << std::endl;
+        
+        // 1e6 uniform samples: every quantile should land within ~1% of q
+        QuantileSketch whole, left, right;
+        Xoshiro256 gen(42);
+        for (int i = 0; i < 1000000; i++) {
+            double x = (gen() >> 11) * (1.0 / 9007199254740992.0);
+            whole.add(x);
+            (i % 2 == 0 ? left : right).add(x);
+        }
+        bool accurate = true;
+        for (double q : {0.01, 0.25, 0.5, 0.75, 0.99}) {
+            accurate &= std::fabs(whole.quantile(q) - q) < 0.01;
+        }
+        std::cout << "Quantiles of uniform within 0.01: " << (accurate ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Memory under 16 KB after 1e6 samples: " << (whole.memoryBytes() < 16384 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        left.merge(right);
+        std::cout << "Merged count: " << left.size() << " (expected: 1000000)" << std::endl;
+        std::cout << "Merged median within 0.01: " << (std::fabs(left.quantile(0.5) - 0.5) < 0.01 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        std::stringstream image;
+        left.save(image);
+        QuantileSketch restored;
+        restored.load(image);
+        for (int i = 0; i < 1000; i++) {
+            double x = i / 1000.0;
+            left.add(x);
+            restored.add(x);
+        }
+        std::cout << "Restored sketch continues exactly: "
+                  << (restored.size() == left.size() && restored.quantile(0.3) == left.quantile(0.3) ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        double binned = 0.0;
+        for (const auto& bin : whole.histogram(10)) {
+            binned += bin.count;
+        }
+        std::cout << "Histogram total: " << (long long)binned << " (expected: 1000000)" << std::endl;
+        
+        try {
+            whole.quantile(1.5);
+            std::cout << "ERROR: Should have thrown exception for invalid quantile" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "QuantileSketch tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,226 @@
+#pragma once
+#include "Percolation.hpp"
+#include "FastRandom.hpp"
+#include "WorkerPool.hpp"
+#include "StatsAccumulator.hpp"
+#include <vector>
+#include <cmath>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+// tail probability from independent splitting runs
+struct TailEstimate {
+    double probability;        // mean of the runs' estimates
+    double relativeError;      // standard error / probability, from the spread of the runs
+    int repetitions;
+    int particles;             // particles per stage in each run
+};
+
+// Fixed-effort splitting for P(percolates) at site occupation p, usable far
+// below p_c where plain trials never see a crossing. The grid is revealed
+// one row at a time; the importance function is the deepest row reached by
+// a top-connected cluster, and stage r keeps the particles in which a
+// top-connected cluster reaches row r. Any crossing passes through every
+// row, so P(percolates) is the product of the stage survival fractions.
+// A particle is only its frontier - the open sites of the last row revealed,
+// labelled by connectivity through the rows above, and whether each label
+// reaches the top - so cloning one costs O(n) instead of a whole grid.
+class RareEventSplitting {
+private:
+    int n;
+    double p;
+    int particles;
+    int threads;
+    
+    // frontier of a partially revealed grid
+    struct Frontier {
+        std::vector<int> label;             // per column: cluster label, -1 if closed
+        std::vector<unsigned char> top;     // per label: connected to the top row
+    };
+    
+    // Per-thread scratch for revealing rows
+    struct RowSweep {
+        std::vector<int> parent;            // union-find over old labels and new sites
+        std::vector<unsigned char> rootTop;
+        std::vector<int> relabel;
+        std::vector<unsigned char> open;
+        
+        explicit RowSweep(int n) : parent(2 * n), rootTop(2 * n), relabel(2 * n), open(n) {}
+        
+        int find(int x) {
+            while (parent[x] != x) {
+                parent[x] = parent[parent[x]];   // path halving
+                x = parent[x];
+            }
+            return x;
+        }
+        
+        void unite(int x, int y) {
+            parent[find(x)] = find(y);
+        }
+    };
+    
+    // Reveals the row below `from` into `to`; returns whether a top-connected
+    // cluster reaches the new row
+    bool advance(const Frontier& from, Frontier& to, RowSweep& sweep, Xoshiro256& gen) const {
+        for (int c = 0; c < n; c++) {
+            sweep.open[c] = (gen() >> 11) * (1.0 / 9007199254740992.0) < p;
+        }
+        
+        // Nodes 0..n-1 are the old labels, n..2n-1 the new row's sites
+        std::iota(sweep.parent.begin(), sweep.parent.end(), 0);
+        for (int c = 0; c < n; c++) {
+            if (!sweep.open[c]) continue;
+            if (c > 0 && sweep.open[c - 1]) sweep.unite(n + c, n + c - 1);
+            if (from.label[c] >= 0) sweep.unite(n + c, from.label[c]);
+        }
+        std::fill(sweep.rootTop.begin(), sweep.rootTop.end(), 0);
+        for (int label = 0; label < int(from.top.size()); label++) {
+            sweep.rootTop[sweep.find(label)] |= from.top[label];
+        }
+        
+        // Canonical labels for the new frontier, in column order
+        std::fill(sweep.relabel.begin(), sweep.relabel.end(), -1);
+        to.label.resize(n);
+        to.top.clear();
+        bool reached = false;
+        for (int c = 0; c < n; c++) {
+            if (!sweep.open[c]) {
+                to.label[c] = -1;
+                continue;
+            }
+            int root = sweep.find(n + c);
+            if (sweep.relabel[root] < 0) {
+                sweep.relabel[root] = int(to.top.size());
+                to.top.push_back(sweep.rootTop[root]);
+            }
+            to.label[c] = sweep.relabel[root];
+            reached |= to.top[to.label[c]] != 0;
+        }
+        return reached;
+    }
+    
+    // One splitting run: the product of the n stage survival fractions
+    double run(uint64_t seed) const {
+        Xoshiro256 gen(seed);
+        RowSweep sweep(n);
+        
+        // Above row 0 sits an open, top-connected virtual row
+        Frontier start;
+        start.label.assign(n, 0);
+        start.top.assign(1, 1);
+        std::vector<Frontier> survivors(1, start);
+        std::vector<Frontier> next(particles);
+        
+        double estimate = 1.0;
+        for (int row = 0; row < n; row++) {
+            int alive = 0;
+            for (int i = 0; i < particles; i++) {
+                const Frontier& parent = survivors[gen.bounded(uint32_t(survivors.size()))];
+                if (advance(parent, next[alive], sweep, gen)) alive++;
+            }
+            if (alive == 0) return 0.0;
+            estimate *= double(alive) / particles;
+            
+            survivors.resize(alive);
+            for (int i = 0; i < alive; i++) {
+                std::swap(survivors[i], next[i]);
+            }
+        }
+        return estimate;
+    }
+
+public:
+    // n-by-n grid, sites open with probability p; particles per stage
+    RareEventSplitting(int n, double p, int particles = 1000, int threads = 1)
+        : n(n), p(p), particles(particles), threads(threads) {
+        if (n <= 0) {
+            throw std::invalid_argument("Grid size must be positive");
+        }
+        if (p < 0.0 || p > 1.0) {
+            throw std::invalid_argument("Occupation probability must be in [0, 1]");
+        }
+        if (particles < 2) {
+            throw std::invalid_argument("Splitting needs at least two particles per stage");
+        }
+        if (threads <= 0) {
+            throw std::invalid_argument("Thread count must be positive");
+        }
+    }
+    
+    // P(percolates) from independent runs spread over the threads
+    TailEstimate estimate(int repetitions, uint64_t seed = std::random_device{}()) const {
+        if (repetitions < 2) {
+            throw std::invalid_argument("Relative error needs at least two repetitions");
+        }
+        
+        std::vector<double> runs(repetitions);
+        WorkerPool pool(threads, false);
+        pool.run([&](int worker) {
+            for (int r = worker; r < repetitions; r += threads) {
+                runs[r] = run(SplitMix64(seed ^ (0x9e3779b97f4a7c15ULL * (r + 1))).next());
+            }
+        });
+        
+        StatsAccumulator spread;
+        for (double estimate : runs) spread.add(estimate);
+        
+        TailEstimate result;
+        result.probability = spread.mean();
+        result.relativeError = spread.mean() > 0 ? spread.stddev() / std::sqrt(double(repetitions)) / spread.mean() : 0.0;
+        result.repetitions = repetitions;
+        result.particles = particles;
+        return result;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing RareEventSplitting class..." << std::endl;
+        
+        // A single site percolates exactly when it is open
+        TailEstimate single = RareEventSplitting(1, 0.25, 4000).estimate(8, 1);
+        std::cout << "n=1, p=0.25 within 5%: " << (std::fabs(single.probability - 0.25) < 0.0125 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        // A 2x2 grid percolates iff a column is open: 1 - (1 - p^2)^2
+        TailEstimate small = RareEventSplitting(2, 0.5, 4000).estimate(8, 2);
+        std::cout << "n=2, p=0.5 within 5% of 0.4375: " << (std::fabs(small.probability - 0.4375) < 0.022 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // 3x3 at p=0.05 (P ~ 4e-4): exact value by enumerating all 512 grids
+        double p = 0.05;
+        double exact = 0.0;
+        for (int mask = 0; mask < 512; mask++) {
+            Percolation grid(3);
+            int open = 0;
+            for (int site = 0; site < 9; site++) {
+                if (mask >> site & 1) {
+                    grid.open(site / 3, site % 3);
+                    open++;
+                }
+            }
+            if (grid.percolates()) exact += std::pow(p, open) * std::pow(1 - p, 9 - open);
+        }
+        TailEstimate rare = RareEventSplitting(3, p, 2000, 2).estimate(20, 3);
+        std::cout << "n=3, p=0.05 within 4 standard errors of exact: "
+                  << (std::fabs(rare.probability - exact) < 4 * rare.relativeError * rare.probability ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // Deep tail: finite, nonzero, with a usable relative error
+        TailEstimate deep = RareEventSplitting(32, 0.3, 500).estimate(4, 4);
+        std::cout << "n=32, p=0.3 estimate in (0, 1e-8) with relative error < 0.5: "
+                  << (deep.probability > 0 && deep.probability < 1e-8 && deep.relativeError < 0.5 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        try {
+            RareEventSplitting invalid(8, 1.5);
+            std::cout << "ERROR: Should have thrown exception for invalid p" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "RareEventSplitting tests completed." << std::endl;
+    }
+};
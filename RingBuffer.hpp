@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#include <iostream>
+
+// Lock-free single-producer / single-consumer ring buffer. One thread may
+// call tryPush and one other thread may call tryPop; neither ever blocks.
+template <typename T>
+class RingBuffer {
+private:
+    static const size_t CACHE_LINE = 64;
+    
+    std::vector<T> slots;
+    size_t mask;
+    alignas(CACHE_LINE) std::atomic<size_t> head;   // next slot to pop (consumer owned)
+    alignas(CACHE_LINE) std::atomic<size_t> tail;   // next slot to push (producer owned)
+
+public:
+    // capacity is rounded up to a power of two
+    explicit RingBuffer(size_t capacity) : head(0), tail(0) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Ring capacity must be positive");
+        }
+        
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+    
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    
+    // producer side: false if the ring is full
+    bool tryPush(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask) return false;
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // consumer side: false if the ring is empty
+    bool tryPop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // number of queued items (exact only when both sides are idle)
+    size_t sizeApprox() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+    
+    size_t capacity() const {
+        return mask + 1;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing RingBuffer class..." << std::endl;
+        
+        RingBuffer<int> ring(3);
+        std::cout << "Capacity for 3 requested: " << ring.capacity() << " (expected: 4)" << std::endl;
+        
+        int pushed = 0;
+        while (ring.tryPush(pushed)) pushed++;
+        std::cout << "Pushes before full: " << pushed << " (expected: 4)" << std::endl;
+        
+        int value = -1;
+        ring.tryPop(value);
+        std::cout << "First pop: " << value << " (expected: 0)" << std::endl;
+        ring.tryPush(4);
+        int last = -1;
+        while (ring.tryPop(value)) last = value;
+        std::cout << "Last pop after wrap-around: " << last << " (expected: 4)" << std::endl;
+        std::cout << "Empty after draining: " << (ring.sizeApprox() == 0 ? "true" : "false") << " (expected: true)" << std::endl;
+        
+        std::cout << "RingBuffer tests completed." << std::endl;
+    }
+};
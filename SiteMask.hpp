@@ -0,0 +1,325 @@
+#pragma once
+#include "BinaryIO.hpp"
+#include "Percolation.hpp"
+#include "FastRandom.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cctype>
+#include <stdexcept>
+#include <iostream>
+
+// outcome of labeling a mask
+struct MaskResult {
+    bool percolates;              // an open path joins the top row to the bottom row
+    long long openSites;
+    long long fullSites;          // open sites joined to the top row (-1 unless full sites were asked for)
+};
+
+// An externally supplied occupancy mask - a binary PBM (P4) image or raw
+// packed bits - mapped read-only and labeled with a Hoshen-Kopelman raster
+// scan instead of one Percolation::open() per site. Rows are packed
+// most-significant bit first and padded to whole bytes, as in PBM; a set
+// bit is an open site unless the mask is inverted. Percolation runs from
+// the top row to the bottom row, on any width and height.
+class SiteMask {
+private:
+    MappedFile file;
+    const uint8_t* bits;
+    int w;
+    int h;
+    size_t stride;                // bytes per row
+    bool invert;
+    
+    // parse "P4 <width> <height>" with comments; returns the offset of the pixel data
+    size_t parsePbmHeader(const std::string& path) {
+        const char* text = file.data();
+        size_t size = file.size(), at = 2;
+        if (size < 2 || text[0] != 'P' || text[1] != '4') {
+            throw std::runtime_error("Not a binary PBM (P4) image: " + path);
+        }
+        long long values[2];
+        for (long long& value : values) {
+            while (at < size && (std::isspace((unsigned char)text[at]) || text[at] == '#')) {
+                if (text[at] == '#') {
+                    while (at < size && text[at] != '\n') at++;
+                } else {
+                    at++;
+                }
+            }
+            if (at == size || !std::isdigit((unsigned char)text[at])) {
+                throw std::runtime_error("Bad PBM header: " + path);
+            }
+            value = 0;
+            while (at < size && std::isdigit((unsigned char)text[at]) && value <= (1LL << 31)) {
+                value = value * 10 + (text[at++] - '0');
+            }
+        }
+        if (at == size || !std::isspace((unsigned char)text[at])) {
+            throw std::runtime_error("Bad PBM header: " + path);
+        }
+        setSize(values[0], values[1], path);
+        return at + 1;
+    }
+    
+    void setSize(long long width, long long height, const std::string& path) {
+        if (width <= 0 || height <= 0 || width > (1LL << 30) || height > (1LL << 30)) {
+            throw std::invalid_argument("Mask width and height must be positive: " + path);
+        }
+        w = int(width);
+        h = int(height);
+        stride = (size_t(w) + 7) / 8;
+    }
+    
+    void checkLength(size_t offset, const std::string& path) const {
+        if (file.size() < offset || file.size() - offset < stride * size_t(h)) {
+            throw std::runtime_error("Mask file shorter than its " + std::to_string(w) + "x" + std::to_string(h) + " pixels: " + path);
+        }
+    }
+    
+    bool openAt(const uint8_t* row, int col) const {
+        return (((row[col >> 3] >> (7 - (col & 7))) & 1) != 0) != invert;
+    }
+    
+    static int find(std::vector<int>& parent, int x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+    
+    // join the labels' roots; the top-row flag follows the surviving root
+    static int unite(std::vector<int>& parent, std::vector<uint8_t>& top, int a, int b) {
+        a = find(parent, a);
+        b = find(parent, b);
+        if (a == b) return a;
+        if (b < a) std::swap(a, b);
+        parent[b] = a;
+        top[a] |= top[b];
+        return a;
+    }
+
+public:
+    // binary PBM image; invert: clear bits are the open sites
+    explicit SiteMask(const std::string& path, bool invert = false) : file(path), invert(invert) {
+        size_t offset = parsePbmHeader(path);
+        checkLength(offset, path);
+        bits = reinterpret_cast<const uint8_t*>(file.data()) + offset;
+    }
+    
+    // raw packed bits, width x height, rows padded to whole bytes
+    SiteMask(const std::string& path, int width, int height, bool invert = false) : file(path), invert(invert) {
+        setSize(width, height, path);
+        checkLength(0, path);
+        bits = reinterpret_cast<const uint8_t*>(file.data());
+    }
+    
+    int width() const {
+        return w;
+    }
+    
+    int height() const {
+        return h;
+    }
+    
+    bool isOpen(int row, int col) const {
+        if (row < 0 || row >= h || col < 0 || col >= w) {
+            throw std::out_of_range("Site outside the mask");
+        }
+        return openAt(bits + size_t(row) * stride, col);
+    }
+    
+    // Single pass keeping only the previous row's labels: after each row
+    // the live clusters are renumbered 0..k-1 with a flag for "reaches the
+    // top row", so memory stays O(width) whatever the height
+    MaskResult percolates() const {
+        std::vector<int> previous(w, -1), current(w, -1);
+        std::vector<int> parent, remap;
+        std::vector<uint8_t> top, nextTop;
+        parent.reserve(2 * size_t(w));
+        top.reserve(2 * size_t(w));
+        int live = 0;                          // labels carried over from the row above
+        long long open = 0;
+        
+        for (int r = 0; r < h; r++) {
+            const uint8_t* row = bits + size_t(r) * stride;
+            parent.resize(live);
+            for (int label = 0; label < live; label++) parent[label] = label;
+            top.resize(live);
+            
+            for (int c = 0; c < w; c++) {
+                if ((c & 7) == 0 && row[c >> 3] == (invert ? 0xff : 0x00)) {
+                    // eight closed sites at once
+                    int end = std::min(c + 8, w);
+                    for (; c < end; c++) current[c] = -1;
+                    c--;
+                    continue;
+                }
+                if (!openAt(row, c)) {
+                    current[c] = -1;
+                    continue;
+                }
+                open++;
+                int up = previous[c];
+                int left = c > 0 ? current[c - 1] : -1;
+                if (up < 0 && left < 0) {
+                    current[c] = int(parent.size());
+                    parent.push_back(current[c]);
+                    top.push_back(r == 0);
+                } else if (up >= 0 && left >= 0) {
+                    current[c] = unite(parent, top, up, left);
+                } else {
+                    current[c] = find(parent, up >= 0 ? up : left);
+                }
+            }
+            
+            // Renumber the row's clusters densely for the next row
+            remap.assign(parent.size(), -1);
+            nextTop.clear();
+            for (int c = 0; c < w; c++) {
+                if (current[c] < 0) continue;
+                int root = find(parent, current[c]);
+                if (remap[root] < 0) {
+                    remap[root] = int(nextTop.size());
+                    nextTop.push_back(top[root]);
+                }
+                current[c] = remap[root];
+            }
+            top.swap(nextTop);
+            live = int(top.size());
+            previous.swap(current);
+        }
+        
+        bool percolates = false;
+        for (int c = 0; c < w && !percolates; c++) {
+            percolates = previous[c] >= 0 && top[previous[c]];
+        }
+        return MaskResult{percolates, open, -1};
+    }
+    
+    // The same scan keeping every site's label (4 bytes per site), then a
+    // resolve pass: full[] gets the full sites packed like the input rows
+    MaskResult fullSites(std::vector<uint8_t>& full) const {
+        size_t sites = size_t(w) * h;
+        std::vector<int> label(sites, -1);
+        std::vector<int> parent;
+        std::vector<uint8_t> top;
+        long long open = 0;
+        
+        for (int r = 0; r < h; r++) {
+            const uint8_t* row = bits + size_t(r) * stride;
+            int* current = label.data() + size_t(r) * w;
+            const int* previous = r > 0 ? current - w : nullptr;
+            for (int c = 0; c < w; c++) {
+                if (!openAt(row, c)) continue;
+                open++;
+                int up = previous ? previous[c] : -1;
+                int left = c > 0 ? current[c - 1] : -1;
+                if (up < 0 && left < 0) {
+                    current[c] = int(parent.size());
+                    parent.push_back(current[c]);
+                    top.push_back(r == 0);
+                } else if (up >= 0 && left >= 0) {
+                    current[c] = unite(parent, top, up, left);
+                } else {
+                    current[c] = up >= 0 ? up : left;
+                }
+            }
+        }
+        
+        full.assign(stride * size_t(h), 0);
+        long long fullCount = 0;
+        bool percolates = false;
+        for (int r = 0; r < h; r++) {
+            for (int c = 0; c < w; c++) {
+                int l = label[size_t(r) * w + c];
+                if (l < 0 || !top[find(parent, l)]) continue;
+                full[size_t(r) * stride + (c >> 3)] |= uint8_t(0x80 >> (c & 7));
+                fullCount++;
+                if (r == h - 1) percolates = true;
+            }
+        }
+        return MaskResult{percolates, open, fullCount};
+    }
+    
+    // write packed rows (as produced by fullSites) as a binary PBM image
+    static void writePbm(const std::string& path, int width, int height, const std::vector<uint8_t>& rows) {
+        size_t rowBytes = (size_t(width) + 7) / 8;
+        if (rows.size() != rowBytes * size_t(height)) {
+            throw std::invalid_argument("Pixel data does not match " + std::to_string(width) + "x" + std::to_string(height));
+        }
+        std::string header = "P4\n" + std::to_string(width) + " " + std::to_string(height) + "\n";
+        BinaryIO::replaceFile(path, header + std::string(rows.begin(), rows.end()));
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing SiteMask class..." << std::endl;
+        
+        // Random masks against the union-find engine, site by site
+        std::string path = "sitemask_test.pbm";
+        int n = 37;
+        size_t rowBytes = (n + 7) / 8;
+        bool agree = true;
+        int percolating = 0;
+        Xoshiro256 gen(2024);
+        for (int trial = 0; trial < 20; trial++) {
+            std::vector<uint8_t> rows(rowBytes * n, 0);
+            Percolation perc(n);
+            for (int r = 0; r < n; r++) {
+                for (int c = 0; c < n; c++) {
+                    if (gen.bounded(1000) < 593) {
+                        rows[r * rowBytes + c / 8] |= uint8_t(0x80 >> (c % 8));
+                        perc.open(r, c);
+                    }
+                }
+            }
+            writePbm(path, n, n, rows);
+            SiteMask mask(path);
+            std::vector<uint8_t> full;
+            MaskResult streamed = mask.percolates();
+            MaskResult labeled = mask.fullSites(full);
+            agree &= streamed.percolates == perc.percolates() && labeled.percolates == perc.percolates();
+            agree &= streamed.openSites == perc.numberOfOpenSites();
+            for (int r = 0; r < n; r++) {
+                for (int c = 0; c < n; c++) {
+                    // Percolation reports no backwash, so full means joined to the top
+                    bool isFull = (full[r * rowBytes + c / 8] >> (7 - c % 8)) & 1;
+                    agree &= isFull == perc.isFull(r, c);
+                }
+            }
+            percolating += streamed.percolates;
+        }
+        std::cout << "Mask labeling matches Percolation on 20 masks: " << (agree ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Some but not all masks percolate: " << (percolating > 0 && percolating < 20 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // A U whose right arm is labeled apart from the top and only joins it in the last row
+        //   #..
+        //   #.#
+        //   ###
+        std::vector<uint8_t> u = {0x80, 0xa0, 0xe0};
+        BinaryIO::replaceFile(path, std::string(u.begin(), u.end()));
+        SiteMask raw(path, 3, 3);
+        std::vector<uint8_t> full;
+        MaskResult result = raw.fullSites(full);
+        std::cout << "U percolates with " << result.fullSites << " full sites: " << (result.percolates ? "true" : "false")
+                  << " (expected: 6 full sites: true)" << std::endl;
+        std::cout << "Right arm full: " << ((full[1] >> 5) & 1) << " (expected: 1)" << std::endl;
+        SiteMask inverted(path, 3, 3, true);
+        std::cout << "Inverted U percolates: " << (inverted.percolates().percolates ? "true" : "false") << " (expected: false)" << std::endl;
+        
+        try {
+            SiteMask tooShort(path, 3, 4);
+            std::cout << "ERROR: Should have thrown exception for a short mask file" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Correctly caught runtime error: " << e.what() << std::endl;
+        }
+        std::remove(path.c_str());
+        
+        std::cout << "SiteMask tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include "BinaryIO.hpp"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+
+// Streaming mean / variance in O(1) memory (Welford). Accumulators built
+// over disjoint samples merge exactly (Chan et al.), so per-thread or
+// per-shard results can be combined without keeping the samples.
+class StatsAccumulator {
+private:
+    long long count;
+    double runningMean;
+    double sumSquaredDiffs;           // sum of squared deviations from the running mean
+    double minimum;
+    double maximum;
+
+public:
+    StatsAccumulator()
+        : count(0), runningMean(0.0), sumSquaredDiffs(0.0),
+          minimum(std::numeric_limits<double>::infinity()),
+          maximum(-std::numeric_limits<double>::infinity()) {}
+    
+    // add one sample
+    void add(double x) {
+        count++;
+        double delta = x - runningMean;
+        runningMean += delta / count;
+        sumSquaredDiffs += delta * (x - runningMean);
+        minimum = std::min(minimum, x);
+        maximum = std::max(maximum, x);
+    }
+    
+    // fold in an accumulator built over a disjoint set of samples
+    void merge(const StatsAccumulator& other) {
+        if (other.count == 0) return;
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        
+        long long total = count + other.count;
+        double delta = other.runningMean - runningMean;
+        runningMean += delta * other.count / total;
+        sumSquaredDiffs += other.sumSquaredDiffs + delta * delta * ((double)count * other.count / total);
+        count = total;
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+    }
+    
+    long long size() const { return count; }
+    
+    double mean() const { return runningMean; }
+    
+    // sample variance (n - 1 denominator)
+    double variance() const { return sumSquaredDiffs / (count - 1); }
+    
+    double stddev() const { return std::sqrt(variance()); }
+    
+    double min() const { return minimum; }
+    
+    double max() const { return maximum; }
+    
+    // exact binary image of the running state, for checkpoints
+    void save(std::ostream& out) const {
+        BinaryIO::write(out, count);
+        BinaryIO::write(out, runningMean);
+        BinaryIO::write(out, sumSquaredDiffs);
+        BinaryIO::write(out, minimum);
+        BinaryIO::write(out, maximum);
+    }
+    
+    void load(std::istream& in) {
+        count = BinaryIO::read<long long>(in);
+        runningMean = BinaryIO::read<double>(in);
+        sumSquaredDiffs = BinaryIO::read<double>(in);
+        minimum = BinaryIO::read<double>(in);
+        maximum = BinaryIO::read<double>(in);
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing StatsAccumulator class..." << std::endl;
+        
+        // Samples 1..10: mean 5.5, sample variance 55/6
+        StatsAccumulator all, low, high;
+        for (int i = 1; i <= 10; i++) {
+            all.add(i);
+            (i <= 4 ? low : high).add(i);
+        }
+        std::cout << "Mean of 1..10: " << all.mean() << " (expected: 5.5)" << std::endl;
+        std::cout << "Variance of 1..10: " << all.variance() << " (expected: " << 55.0 / 6.0 << ")" << std::endl;
+        
+        low.merge(high);
+        std::cout << "Merged count: " << low.size() << " (expected: 10)" << std::endl;
+        std::cout << "Merged mean matches: " << (std::fabs(low.mean() - all.mean()) < 1e-12 ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Merged variance matches: " << (std::fabs(low.variance() - all.variance()) < 1e-12 ? "true" : "false") << " (expected: true)" << std::endl;
+        std::cout << "Merged range: [" << low.min() << ", " << low.max() << "] (expected: [1, 10])" << std::endl;
+        
+        StatsAccumulator empty;
+        empty.merge(all);
+        std::cout << "Merge into empty keeps mean: " << empty.mean() << " (expected: 5.5)" << std::endl;
+        
+        std::stringstream image;
+        all.save(image);
+        StatsAccumulator restored;
+        restored.load(image);
+        restored.add(11);
+        all.add(11);
+        std::cout << "Restored accumulator continues exactly: "
+                  << (restored.mean() == all.mean() && restored.variance() == all.variance() ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        std::cout << "StatsAccumulator tests completed." << std::endl;
+    }
+};
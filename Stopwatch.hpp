@@ -0,0 +1,260 @@
+#pragma once
+
+#include <chrono>
+#include <ratio>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
+// number of seconds per tick of the steady clock
+const double PERIOD = (double) std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+
+// Wall-clock intervals on the steady clock, which never jumps backwards
+// (high_resolution_clock may be the adjustable system clock)
+class Stopwatch {
+public:
+    Stopwatch() : start {std::chrono::steady_clock::now()} {
+    }
+    void reset() {
+        start = std::chrono::steady_clock::now();
+    }
+    double elapsedTime() const {
+        const auto now = std::chrono::steady_clock::now();
+        return ((now - start).count()) * PERIOD; // convert to seconds and return
+    }
+private:
+    std::chrono::time_point<std::chrono::steady_clock> start;
+};
+
+// Tick counter for sub-microsecond sections: the time-stamp counter where it
+// runs at a constant rate (invariant TSC), calibrated once against the
+// steady clock; steady-clock nanoseconds elsewhere. The cost of one read is
+// measured too, so per-call timings can have it taken back out.
+class FastClock {
+private:
+    struct Calibration {
+        bool tsc = false;
+        double secondsPerTick = 1e-9;
+        double readTicks = 0.0;         // ticks one now() adds to a timed interval
+    };
+    
+    static uint64_t read(bool tsc) {
+#if defined(__x86_64__) || defined(__i386__)
+        if (tsc) return __rdtsc();
+#endif
+        (void)tsc;
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    
+    static bool invariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) return false;
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        return (edx >> 8) & 1;
+#else
+        return false;
+#endif
+    }
+    
+    // ~10 ms spin against the steady clock, done on first use
+    static const Calibration& calibration() {
+        static const Calibration calibrated = []() {
+            Calibration c;
+#if defined(__x86_64__) || defined(__i386__)
+            if (invariantTsc()) {
+                Stopwatch sw;
+                uint64_t begin = __rdtsc();
+                while (sw.elapsedTime() < 0.01) {
+                }
+                uint64_t ticks = __rdtsc() - begin;
+                double seconds = sw.elapsedTime();
+                if (ticks > 0) {
+                    c.tsc = true;
+                    c.secondsPerTick = seconds / double(ticks);
+                }
+            }
+#endif
+            // Cheapest of a few batches of back-to-back reads
+            const int reads = 1000;
+            for (int batch = 0; batch < 5; batch++) {
+                uint64_t begin = read(c.tsc);
+                for (int i = 0; i < reads; i++) read(c.tsc);
+                double perRead = double(read(c.tsc) - begin) / (reads + 1);
+                if (batch == 0 || perRead < c.readTicks) c.readTicks = perRead;
+            }
+            return c;
+        }();
+        return calibrated;
+    }
+
+public:
+    static uint64_t now() {
+        return read(calibration().tsc);
+    }
+    
+    static double seconds(uint64_t ticks) {
+        return double(ticks) * calibration().secondsPerTick;
+    }
+    
+    static bool usesTsc() {
+        return calibration().tsc;
+    }
+    
+    // ticks a single now() call costs
+    static double readTicks() {
+        return calibration().readTicks;
+    }
+};
+
+// Accumulated time and entry count per named phase. One instance per
+// thread; merge() combines them after the threads have finished. Reported
+// times have the clock's own read cost removed, once per call.
+class PhaseTimes {
+private:
+    std::vector<std::string> names;
+    std::vector<uint64_t> ticks;
+    std::vector<long long> calls;
+    
+    double netSeconds(size_t phase) const {
+        double net = double(ticks[phase]) - FastClock::readTicks() * double(calls[phase]);
+        return net > 0 ? FastClock::seconds(uint64_t(net)) : 0.0;
+    }
+
+public:
+    explicit PhaseTimes(const std::vector<std::string>& names = {})
+        : names(names), ticks(names.size(), 0), calls(names.size(), 0) {
+    }
+    
+    void add(int phase, uint64_t elapsed) {
+        ticks[phase] += elapsed;
+        calls[phase]++;
+    }
+    
+    void merge(const PhaseTimes& other) {
+        if (names.empty()) {
+            *this = other;
+            return;
+        }
+        for (size_t p = 0; p < ticks.size() && p < other.ticks.size(); p++) {
+            ticks[p] += other.ticks[p];
+            calls[p] += other.calls[p];
+        }
+    }
+    
+    double seconds(int phase) const {
+        return netSeconds(phase);
+    }
+    
+    long long count(int phase) const {
+        return calls[phase];
+    }
+    
+    double totalSeconds() const {
+        double total = 0.0;
+        for (size_t p = 0; p < ticks.size(); p++) total += netSeconds(p);
+        return total;
+    }
+    
+    bool empty() const {
+        for (long long c : calls) {
+            if (c > 0) return false;
+        }
+        return true;
+    }
+    
+    // one row per phase; times are multiplied by scale (e.g. to undo sampling)
+    void print(std::ostream& out, double scale = 1.0) const {
+        std::ios::fmtflags flags = out.flags();
+        double total = totalSeconds();
+        for (size_t p = 0; p < names.size(); p++) {
+            double s = netSeconds(p);
+            out << "  " << std::left << std::setw(12) << names[p] << std::right
+                << std::fixed << std::setprecision(6) << std::setw(12) << s * scale << " s"
+                << std::setprecision(1) << std::setw(7) << (total > 0 ? 100.0 * s / total : 0.0) << "%"
+                << std::setw(14) << calls[p] << " calls"
+                << std::setprecision(1) << std::setw(10) << (calls[p] > 0 ? 1e9 * s / calls[p] : 0.0) << " ns/call\n";
+        }
+        out.flags(flags);
+    }
+    
+    // unit testing
+    static void test();
+};
+
+// Adds the time from construction to destruction to one phase
+class ScopedPhase {
+public:
+    ScopedPhase(PhaseTimes& times, int phase) : times(times), phase(phase), start(FastClock::now()) {
+    }
+    ~ScopedPhase() {
+        times.add(phase, FastClock::now() - start);
+    }
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+private:
+    PhaseTimes& times;
+    int phase;
+    uint64_t start;
+};
+
+// Back-to-back phases with one clock read per boundary: mark(p) charges the
+// time since the previous mark to p
+class PhaseLap {
+public:
+    explicit PhaseLap(PhaseTimes& times) : times(times), last(FastClock::now()) {
+    }
+    void mark(int phase) {
+        uint64_t now = FastClock::now();
+        times.add(phase, now - last);
+        last = now;
+    }
+private:
+    PhaseTimes& times;
+    uint64_t last;
+};
+
+// Stands in for PhaseLap in code instantiated without timing; compiles away
+struct NoPhaseLap {
+    void mark(int) {}
+};
+
+inline void PhaseTimes::test() {
+    std::cout << "Testing PhaseTimes class..." << std::endl;
+    
+    std::cout << "Fast clock source: " << (FastClock::usesTsc() ? "invariant TSC" : "steady clock") << std::endl;
+    Stopwatch sw;
+    uint64_t begin = FastClock::now();
+    while (sw.elapsedTime() < 0.005) {
+    }
+    double fast = FastClock::seconds(FastClock::now() - begin);
+    double steady = sw.elapsedTime();
+    std::cout << "Fast clock agrees with steady clock within 10%: "
+              << (fast > 0.9 * steady && fast < 1.1 * steady ? "true" : "false") << " (expected: true)" << std::endl;
+    
+    PhaseTimes times({"first", "second"});
+    for (int i = 0; i < 3; i++) {
+        ScopedPhase scope(times, 0);
+    }
+    PhaseLap lap(times);
+    lap.mark(1);
+    lap.mark(1);
+    NoPhaseLap off;
+    off.mark(0);
+    std::cout << "Calls per phase: " << times.count(0) << ", " << times.count(1) << " (expected: 3, 2)" << std::endl;
+    
+    PhaseTimes merged;
+    merged.merge(times);
+    merged.merge(times);
+    std::cout << "Merged calls: " << merged.count(0) << " (expected: 6)" << std::endl;
+    
+    std::cout << "PhaseTimes tests completed." << std::endl;
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include "PercolationStat.hpp"
+#include "BenchmarkRunner.hpp"
+#include "WorkerPool.hpp"
+#include "MemoryUsage.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+// one thread count of a strong or weak scaling run
+struct ThreadScalingPoint {
+    int threads;
+    int trials;                // total trials in the run
+    double seconds;            // median wall time
+    double trialsPerSecond;
+    double speedup;            // throughput relative to one thread
+    double efficiency;         // speedup / threads
+    double gridBytesPerSecond; // grid bytes reset and walked per second, a floor on memory traffic
+};
+
+// Strong and weak scaling of PercolationStats over 1, 2, 4, ... threads up
+// to every allowed core. Strong scaling splits a fixed trial count; weak
+// scaling gives each thread the same number of trials, so the work per
+// thread is constant and any efficiency lost is contention for shared
+// resources - for large grids, memory bandwidth. The saturation point is
+// the first thread count whose weak-scaling efficiency falls below the
+// threshold; the count just before it is how many jobs a host can run side
+// by side without slowing each other down.
+class ThreadScaling {
+private:
+    int n;
+    int trialsPerThread;
+    int maxThreads;
+    double threshold;
+    BenchmarkOptions benchOptions;
+    
+    ThreadScalingPoint measure(int threads, int trials, double baseRate) const {
+        StatsOptions options;
+        options.threads = threads;
+        options.pinThreads = true;
+        options.seed = 0x5ca1ab1e;
+        
+        // The pool pins its own workers; the caller's thread stays free
+        BenchmarkRunner runner(benchOptions);
+        BenchmarkResult result = runner.run("scaling", [&]() { PercolationStats stats(n, trials, options); });
+        if (result.timedOut) {
+            throw std::runtime_error("Scaling run over the time limit at " + std::to_string(threads) + " threads");
+        }
+        
+        ThreadScalingPoint point;
+        point.threads = threads;
+        point.trials = trials;
+        point.seconds = result.median;
+        point.trialsPerSecond = trials / result.median;
+        point.speedup = baseRate > 0 ? point.trialsPerSecond / baseRate : 1.0;
+        point.efficiency = point.speedup / threads;
+        point.gridBytesPerSecond = point.trialsPerSecond * double(Percolation::bytesFor(n));
+        return point;
+    }
+
+public:
+    // trialsPerThread: weak-scaling share, and the strong workload per thread at maxThreads
+    // maxThreads: 0 = every allowed core; threshold: efficiency counted as saturated below it
+    ThreadScaling(int n, int trialsPerThread, int maxThreads = 0, double threshold = 0.85)
+        : n(n), trialsPerThread(trialsPerThread), maxThreads(maxThreads > 0 ? maxThreads : WorkerPool::hardwareThreads()),
+          threshold(threshold) {
+        if (n <= 0 || trialsPerThread <= 0) {
+            throw std::invalid_argument("Grid size and trials per thread must be positive");
+        }
+        if (threshold <= 0.0 || threshold > 1.0) {
+            throw std::invalid_argument("Efficiency threshold must be in (0, 1]");
+        }
+        benchOptions.pin = false;
+        benchOptions.minRuns = 3;
+        benchOptions.maxRuns = 7;
+        benchOptions.timeLimit = 600.0;
+    }
+    
+    // 1, 2, 4, ... and maxThreads itself when it is not a power of two
+    static std::vector<int> threadCounts(int maxThreads) {
+        std::vector<int> counts;
+        for (int k = 1; k < maxThreads; k *= 2) counts.push_back(k);
+        counts.push_back(maxThreads);
+        return counts;
+    }
+    
+    // fixed total of trialsPerThread * maxThreads trials, split over each thread count
+    std::vector<ThreadScalingPoint> strong() const {
+        int total = trialsPerThread * maxThreads;
+        std::vector<ThreadScalingPoint> points;
+        double baseRate = 0.0;
+        for (int k : threadCounts(maxThreads)) {
+            points.push_back(measure(k, total, baseRate));
+            if (k == 1) baseRate = points.back().trialsPerSecond;
+        }
+        return points;
+    }
+    
+    // trialsPerThread trials per thread at each thread count
+    std::vector<ThreadScalingPoint> weak() const {
+        std::vector<ThreadScalingPoint> points;
+        double baseRate = 0.0;
+        for (int k : threadCounts(maxThreads)) {
+            points.push_back(measure(k, trialsPerThread * k, baseRate));
+            if (k == 1) baseRate = points.back().trialsPerSecond;
+        }
+        return points;
+    }
+    
+    // index of the first point below the efficiency threshold, -1 if none
+    static int saturationIndex(const std::vector<ThreadScalingPoint>& points, double threshold) {
+        for (size_t i = 0; i < points.size(); i++) {
+            if (points[i].efficiency < threshold) return int(i);
+        }
+        return -1;
+    }
+    
+    double efficiencyThreshold() const {
+        return threshold;
+    }
+    
+    // efficiency curve, one row per thread count
+    static void print(std::ostream& out, const std::string& title, const std::vector<ThreadScalingPoint>& points) {
+        std::ios::fmtflags flags = out.flags();
+        out << title << ":" << std::endl;
+        out << std::setw(8) << "threads" << std::setw(9) << "trials" << std::setw(12) << "seconds"
+            << std::setw(12) << "trials/s" << std::setw(10) << "speedup" << std::setw(12) << "efficiency"
+            << std::setw(14) << "grid traffic" << std::endl;
+        for (const auto& p : points) {
+            out << std::setw(8) << p.threads << std::setw(9) << p.trials << std::fixed
+                << std::setprecision(4) << std::setw(12) << p.seconds
+                << std::setprecision(1) << std::setw(12) << p.trialsPerSecond
+                << std::setprecision(2) << std::setw(9) << p.speedup << "x"
+                << std::setprecision(1) << std::setw(11) << 100.0 * p.efficiency << "%"
+                << std::setw(12) << MemoryUsage::format(p.gridBytesPerSecond) << "/s" << std::endl;
+        }
+        out.flags(flags);
+    }
+    
+    // where weak scaling stops being flat, and what that means for co-location
+    void printSaturation(std::ostream& out, const std::vector<ThreadScalingPoint>& weakPoints) const {
+        int at = saturationIndex(weakPoints, threshold);
+        if (at < 0) {
+            out << "No saturation up to " << weakPoints.back().threads << " threads (weak efficiency >= "
+                << int(100 * threshold) << "%): up to " << weakPoints.back().threads << " jobs can share this host" << std::endl;
+            return;
+        }
+        if (at == 0) {
+            out << "Single-thread run already below threshold; measurement too noisy" << std::endl;
+            return;
+        }
+        const ThreadScalingPoint& last = weakPoints[at - 1];
+        out << "Saturation at " << weakPoints[at].threads << " threads (weak efficiency "
+            << std::fixed << std::setprecision(1) << 100.0 * weakPoints[at].efficiency << "%), at about "
+            << MemoryUsage::format(last.gridBytesPerSecond) << "/s of grid traffic" << std::endl;
+        out << "Co-locate at most " << last.threads << (last.threads == 1 ? " job" : " jobs") << " of this size per host" << std::endl;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing ThreadScaling class..." << std::endl;
+        
+        std::vector<int> counts = threadCounts(6);
+        std::cout << "Thread counts up to 6: " << counts.size() << " (";
+        for (size_t i = 0; i < counts.size(); i++) std::cout << (i ? "," : "") << counts[i];
+        std::cout << ") (expected: 4 (1,2,4,6))" << std::endl;
+        std::cout << "Thread counts up to 1: " << threadCounts(1).size() << " (expected: 1)" << std::endl;
+        
+        // Synthetic weak-scaling curve that flattens out after 4 threads
+        std::vector<ThreadScalingPoint> curve;
+        double efficiencies[] = {1.0, 0.97, 0.9, 0.6};
+        for (int i = 0; i < 4; i++) {
+            curve.push_back(ThreadScalingPoint{1 << i, 10 << i, 1.0, 0.0, 0.0, efficiencies[i], 0.0});
+        }
+        std::cout << "Saturation index at 85%: " << saturationIndex(curve, 0.85) << " (expected: 3)" << std::endl;
+        std::cout << "Saturation index at 50%: " << saturationIndex(curve, 0.5) << " (expected: -1)" << std::endl;
+        
+        // One real point: a single thread is its own baseline
+        ThreadScaling small(16, 20, 1);
+        std::vector<ThreadScalingPoint> weak = small.weak();
+        std::cout << "One-thread efficiency: " << std::fixed << std::setprecision(2) << weak[0].efficiency
+                  << " (expected: 1.00)" << std::endl;
+        
+        try {
+            ThreadScaling invalid(16, 0);
+            std::cout << "ERROR: Should have thrown exception for zero trials" << std::endl;
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Correctly caught invalid argument: " << e.what() << std::endl;
+        }
+        
+        std::cout << "ThreadScaling tests completed." << std::endl;
+    }
+};
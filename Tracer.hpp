@@ -0,0 +1,190 @@
+#pragma once
+#include "Stopwatch.hpp"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+
+// one completed span
+struct TraceEvent {
+    const char* name;          // string literal or Tracer::intern()ed
+    const char* category;
+    uint64_t begin;            // FastClock ticks
+    uint64_t end;
+    long long arg;             // trial index, run index, ... (-1 = none)
+};
+
+// Events of one thread. Only the owning thread appends, so recording takes
+// no lock and no atomic; the tracer reads the buffers after the threads join.
+class TraceBuffer {
+private:
+    std::vector<TraceEvent> events;
+    std::string threadName;
+    int tid;
+    
+    friend class Tracer;
+
+public:
+    TraceBuffer(const std::string& threadName, int tid, size_t reserve) : threadName(threadName), tid(tid) {
+        events.reserve(reserve);
+    }
+    
+    void add(const char* name, const char* category, uint64_t begin, uint64_t end, long long arg = -1) {
+        events.push_back(TraceEvent{name, category, begin, end, arg});
+    }
+    
+    size_t size() const {
+        return events.size();
+    }
+};
+
+// Records spans for trials, batches, merges and I/O into per-thread
+// buffers and writes them as Chrome trace-event JSON (chrome://tracing,
+// ui.perfetto.dev). A buffer is registered once per thread, under a lock;
+// after that, recording a span is two FastClock reads and a push_back.
+class Tracer {
+private:
+    uint64_t origin;
+    size_t reserve;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::deque<std::string> names;     // stable storage for intern()
+    
+    static void writeEscaped(std::ostream& out, const char* text) {
+        for (const char* c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') out << '\\';
+            if ((unsigned char)*c >= 0x20) out << *c;
+        }
+    }
+
+public:
+    // reserve: events preallocated per thread buffer
+    explicit Tracer(size_t reserve = 1 << 14) : origin(FastClock::now()), reserve(reserve) {}
+    
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+    
+    // a new buffer for one thread; the name labels its row in the viewer
+    TraceBuffer* thread(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.emplace_back(new TraceBuffer(name, int(buffers.size()) + 1, reserve));
+        return buffers.back().get();
+    }
+    
+    // a copy of name that lives as long as the tracer, for non-literal span names
+    const char* intern(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        names.push_back(name);
+        return names.back().c_str();
+    }
+    
+    size_t eventCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = 0;
+        for (const auto& buffer : buffers) count += buffer->size();
+        return count;
+    }
+    
+    // Trace-event JSON: thread-name metadata, then one complete ("X") event
+    // per span with microsecond timestamps from the tracer's creation.
+    // Only call once the recording threads have finished.
+    void write(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ios::fmtflags flags = out.flags();
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto& buffer : buffers) {
+            out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"name\":\"";
+            writeEscaped(out, buffer->threadName.c_str());
+            out << "\"}}";
+            first = false;
+            for (const auto& event : buffer->events) {
+                double ts = event.begin > origin ? FastClock::seconds(event.begin - origin) * 1e6 : 0.0;
+                double dur = event.end > event.begin ? FastClock::seconds(event.end - event.begin) * 1e6 : 0.0;
+                out << ",\n{\"ph\":\"X\",\"name\":\"";
+                writeEscaped(out, event.name);
+                out << "\",\"cat\":\"";
+                writeEscaped(out, event.category);
+                out << "\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << ts << ",\"dur\":" << dur;
+                if (event.arg >= 0) out << ",\"args\":{\"index\":" << event.arg << "}";
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+        out.flags(flags);
+    }
+    
+    void write(const std::string& path) {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("Cannot open trace file for writing: " + path);
+        }
+        write(out);
+        if (!out) {
+            throw std::runtime_error("Failed writing trace file: " + path);
+        }
+    }
+    
+    // unit testing
+    static void test();
+};
+
+// Records the span from construction to destruction; a null buffer makes it a no-op
+class TraceSpan {
+public:
+    TraceSpan(TraceBuffer* buffer, const char* name, const char* category, long long arg = -1)
+        : buffer(buffer), name(name), category(category), arg(arg), begin(buffer ? FastClock::now() : 0) {
+    }
+    ~TraceSpan() {
+        if (buffer) buffer->add(name, category, begin, FastClock::now(), arg);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    TraceBuffer* buffer;
+    const char* name;
+    const char* category;
+    long long arg;
+    uint64_t begin;
+};
+
+inline void Tracer::test() {
+    std::cout << "Testing Tracer class..." << std::endl;
+    
+    Tracer tracer;
+    TraceBuffer* main = tracer.thread("main \"thread\"");
+    TraceBuffer* worker = tracer.thread("worker 0");
+    {
+        TraceSpan outer(main, "run", "test");
+        for (int t = 0; t < 3; t++) {
+            TraceSpan trial(worker, "trial", "trial", t);
+        }
+        TraceSpan named(main, tracer.intern(std::string("bench") + "mark"), "benchmark");
+    }
+    {
+        TraceSpan off(nullptr, "ignored", "test");
+    }
+    std::cout << "Events recorded: " << tracer.eventCount() << " (expected: 5)" << std::endl;
+    
+    std::ostringstream json;
+    tracer.write(json);
+    std::string text = json.str();
+    size_t complete = 0;
+    for (size_t at = text.find("\"ph\":\"X\""); at != std::string::npos; at = text.find("\"ph\":\"X\"", at + 1)) complete++;
+    std::cout << "Complete events in JSON: " << complete << " (expected: 5)" << std::endl;
+    std::cout << "Thread name escaped: " << (text.find("main \\\"thread\\\"") != std::string::npos ? "true" : "false")
+              << " (expected: true)" << std::endl;
+    std::cout << "Interned name written: " << (text.find("\"name\":\"benchmark\"") != std::string::npos ? "true" : "false")
+              << " (expected: true)" << std::endl;
+    
+    std::cout << "Tracer tests completed." << std::endl;
+}
@@ -0,0 +1,345 @@
+#pragma once
+#include "TrialSink.hpp"
+#include "BinaryIO.hpp"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+// Per-trial results as fixed-width binary columns. A file is a run of
+// self-describing blocks, each a 48-byte header followed by its columns:
+//
+//   char[8]  "PERCTRL1"      uint32 header bytes (48)   uint32 column flags
+//   int32    n               uint32 reserved            uint64 trials in block
+//   uint64   run seed        uint64 column bytes after the header
+//
+//   uint64 trial[count]  uint64 seed[count]  int32 openSites[count] (padded to 8)
+//   double meanClusterSize[count], double spanningStrength[count]   (TRIAL_CLUSTER_STATS only)
+//
+// Values are in host byte order. Every column starts 8-byte aligned, so a
+// mapped file is read in place, and files concatenate with plain `cat`.
+// A block cut short at the end of a file (a writer killed mid-block) is
+// left out when reading; the next checkpointed resume truncates it away.
+enum TrialFileColumns : uint32_t {
+    TRIAL_CLUSTER_STATS = 1       // mean cluster size and spanning strength columns
+};
+
+// one block of a mapped trial file; the pointers point into the mapping
+struct TrialBlock {
+    int n;
+    uint64_t runSeed;
+    size_t count;
+    const uint64_t* trial;
+    const uint64_t* seed;
+    const int32_t* openSites;
+    const double* meanClusterSize;    // null without TRIAL_CLUSTER_STATS
+    const double* spanningStrength;   // null without TRIAL_CLUSTER_STATS
+    
+    double threshold(size_t i) const {
+        return openSites[i] / (double(n) * n);
+    }
+};
+
+// Buffers records column by column and appends a block every blockTrials
+// trials, and on flush(); an existing file is appended to, not replaced.
+// The grid size and run seed for the block headers come from begin(). A
+// checkpoint records the file's length, and a resumed run cuts the file
+// back to it, so trials written after the checkpoint are not repeated.
+class TrialFileWriter : public TrialSink {
+private:
+    static const size_t HEADER_BYTES = 48;
+    
+    std::ofstream out;
+    std::string path;
+    int n = 0;
+    uint64_t runSeed = 0;
+    uint32_t columns;
+    size_t blockTrials;
+    std::vector<uint64_t> trials;
+    std::vector<uint64_t> seeds;
+    std::vector<int32_t> openSites;
+    std::vector<double> clusterSizes;
+    std::vector<double> strengths;
+    uint64_t written = 0;
+    
+    static size_t padded(size_t bytes) {
+        return (bytes + 7) & ~size_t(7);
+    }
+    
+    template <typename T>
+    void writeColumn(const std::vector<T>& column) {
+        size_t bytes = column.size() * sizeof(T);
+        out.write(reinterpret_cast<const char*>(column.data()), std::streamsize(bytes));
+        static const char zeros[8] = {};
+        out.write(zeros, std::streamsize(padded(bytes) - bytes));
+    }
+    
+    void writeBlock() {
+        size_t count = trials.size();
+        if (count == 0) return;
+        uint64_t columnBytes = 2 * count * 8 + padded(count * 4);
+        if (columns & TRIAL_CLUSTER_STATS) columnBytes += 2 * count * 8;
+        
+        out.write("PERCTRL1", 8);
+        BinaryIO::write(out, uint32_t(HEADER_BYTES));
+        BinaryIO::write(out, columns);
+        BinaryIO::write(out, int32_t(n));
+        BinaryIO::write(out, uint32_t(0));
+        BinaryIO::write(out, uint64_t(count));
+        BinaryIO::write(out, runSeed);
+        BinaryIO::write(out, columnBytes);
+        writeColumn(trials);
+        writeColumn(seeds);
+        writeColumn(openSites);
+        if (columns & TRIAL_CLUSTER_STATS) {
+            writeColumn(clusterSizes);
+            writeColumn(strengths);
+        }
+        if (!out) {
+            throw std::runtime_error("Failed writing trial file: " + path);
+        }
+        written += count;
+        trials.clear();
+        seeds.clear();
+        openSites.clear();
+        clusterSizes.clear();
+        strengths.clear();
+    }
+
+public:
+    // columns: TrialFileColumns flags; blockTrials: trials per block at most
+    explicit TrialFileWriter(const std::string& path, uint32_t columns = TRIAL_CLUSTER_STATS, size_t blockTrials = 1 << 16)
+        : out(path, std::ios::binary | std::ios::app), path(path), columns(columns), blockTrials(blockTrials) {
+        if (!out) {
+            throw std::runtime_error("Cannot open trial file for writing: " + path);
+        }
+        if (blockTrials == 0) {
+            throw std::invalid_argument("Trials per block must be positive");
+        }
+        trials.reserve(blockTrials);
+        seeds.reserve(blockTrials);
+        openSites.reserve(blockTrials);
+    }
+    
+    ~TrialFileWriter() {
+        try {
+            writeBlock();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    
+    // a new run starts a new block
+    void begin(int n, int trials, uint64_t runSeed) override {
+        (void)trials;
+        writeBlock();
+        this->n = n;
+        this->runSeed = runSeed;
+    }
+    
+    void write(const TrialRecord* records, size_t count) override {
+        if (n <= 0) {
+            throw std::logic_error("TrialFileWriter::begin() must come before write()");
+        }
+        for (size_t i = 0; i < count; i++) {
+            trials.push_back(records[i].trial);
+            seeds.push_back(records[i].seed);
+            openSites.push_back(records[i].openSites);
+            if (columns & TRIAL_CLUSTER_STATS) {
+                clusterSizes.push_back(records[i].meanClusterSize);
+                strengths.push_back(records[i].spanningStrength);
+            }
+            if (trials.size() == blockTrials) writeBlock();
+        }
+    }
+    
+    void flush() override {
+        writeBlock();
+        out.flush();
+    }
+    
+    void saveState(std::ostream& state) override {
+        BinaryIO::write(state, BinaryIO::fileSize(path));
+    }
+    
+    void restoreState(std::istream& state) override {
+        uint64_t length = BinaryIO::read<uint64_t>(state);
+        writeBlock();
+        out.flush();
+        BinaryIO::truncateFile(path, length);
+    }
+    
+    // trials already written out as blocks
+    uint64_t trialsWritten() const {
+        return written;
+    }
+};
+
+// Maps a trial file (or several concatenated) read-only and indexes its
+// blocks; the columns are read straight out of the page cache
+class TrialFileReader {
+private:
+    MappedFile file;
+    const char* data;
+    size_t length;
+    std::vector<TrialBlock> blockList;
+    size_t torn = 0;
+    
+    void index(const std::string& path) {
+        size_t at = 0;
+        while (at < length) {
+            if (length - at < 48 && std::memcmp(data + at, "PERCTRL1", std::min<size_t>(8, length - at)) == 0) {
+                torn = length - at;
+                break;
+            }
+            if (length - at < 48 || std::memcmp(data + at, "PERCTRL1", 8) != 0) {
+                throw std::runtime_error("Not a trial file block at byte " + std::to_string(at) + " of " + path);
+            }
+            uint32_t headerBytes, columns;
+            int32_t n;
+            uint64_t count, runSeed, columnBytes;
+            std::memcpy(&headerBytes, data + at + 8, 4);
+            std::memcpy(&columns, data + at + 12, 4);
+            std::memcpy(&n, data + at + 16, 4);
+            std::memcpy(&count, data + at + 24, 8);
+            std::memcpy(&runSeed, data + at + 32, 8);
+            std::memcpy(&columnBytes, data + at + 40, 8);
+            
+            bool stats = columns & TRIAL_CLUSTER_STATS;
+            uint64_t expected = 16 * count + ((4 * count + 7) & ~uint64_t(7)) + (stats ? 16 * count : 0);
+            if (headerBytes < 48 || headerBytes % 8 != 0 || columnBytes != expected) {
+                throw std::runtime_error("Corrupt trial file block at byte " + std::to_string(at) + " of " + path);
+            }
+            if (length - at < headerBytes || length - at - headerBytes < columnBytes) {
+                torn = length - at;
+                break;
+            }
+            
+            const char* column = data + at + headerBytes;
+            TrialBlock block;
+            block.n = n;
+            block.runSeed = runSeed;
+            block.count = size_t(count);
+            block.trial = reinterpret_cast<const uint64_t*>(column);
+            block.seed = reinterpret_cast<const uint64_t*>(column + 8 * count);
+            block.openSites = reinterpret_cast<const int32_t*>(column + 16 * count);
+            const char* doubles = column + 16 * count + ((4 * count + 7) & ~uint64_t(7));
+            block.meanClusterSize = stats ? reinterpret_cast<const double*>(doubles) : nullptr;
+            block.spanningStrength = stats ? reinterpret_cast<const double*>(doubles + 8 * count) : nullptr;
+            blockList.push_back(block);
+            at += headerBytes + columnBytes;
+        }
+    }
+
+public:
+    explicit TrialFileReader(const std::string& path) : file(path), data(file.data()), length(file.size()) {
+        index(path);
+    }
+    
+    const std::vector<TrialBlock>& blocks() const {
+        return blockList;
+    }
+    
+    uint64_t trialCount() const {
+        uint64_t total = 0;
+        for (const auto& block : blockList) total += block.count;
+        return total;
+    }
+    
+    // bytes of an incomplete last block that were left out (0 if the file ends cleanly)
+    size_t tornBytes() const {
+        return torn;
+    }
+    
+    // unit testing
+    static void test() {
+        std::cout << "Testing TrialFile classes..." << std::endl;
+        
+        std::string path = "trialfile_test.bin";
+        std::string other = "trialfile_test2.bin";
+        std::remove(path.c_str());
+        std::remove(other.c_str());
+        {
+            TrialFileWriter writer(path, TRIAL_CLUSTER_STATS, 4);
+            writer.begin(10, 10, 99);
+            std::vector<TrialRecord> records;
+            for (int t = 0; t < 10; t++) {
+                records.push_back(TrialRecord{uint64_t(t), 1000u + t, 50 + t, 1.5, 0.25 * (t % 4)});
+            }
+            writer.write(records.data(), records.size());
+            writer.flush();
+            std::cout << "Trials written: " << writer.trialsWritten() << " (expected: 10)" << std::endl;
+        }
+        {
+            TrialFileWriter writer(other, 0);
+            writer.begin(10, 1, 7);
+            TrialRecord record{10, 5, 61, 0.0, 0.0};
+            writer.write(&record, 1);
+        }
+        
+        TrialFileReader reader(path);
+        std::cout << "Blocks of 4: " << reader.blocks().size() << " (expected: 3)" << std::endl;
+        const TrialBlock& last = reader.blocks().back();
+        std::cout << "Last block: " << last.count << " trials, trial " << last.trial[1] << ", seed " << last.seed[1]
+                  << ", threshold " << last.threshold(1) << " (expected: 2 trials, trial 9, seed 1009, threshold 0.59)" << std::endl;
+        std::cout << "Cluster columns present: " << (last.spanningStrength && last.spanningStrength[1] == 0.25 ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // Concatenated files read as one
+        {
+            std::ofstream joined(path, std::ios::binary | std::ios::app);
+            std::ifstream tail(other, std::ios::binary);
+            joined << tail.rdbuf();
+        }
+        TrialFileReader both(path);
+        std::cout << "Concatenated trials: " << both.trialCount() << " (expected: 11)" << std::endl;
+        std::cout << "Block without cluster columns: " << (both.blocks().back().meanClusterSize == nullptr ? "true" : "false")
+                  << " (expected: true)" << std::endl;
+        
+        // A block torn off at the end is left out; the blocks before it still read
+        std::string bytes;
+        BinaryIO::readFile(path, bytes);
+        BinaryIO::replaceFile(other, bytes.substr(0, bytes.size() - 4));
+        TrialFileReader torn(other);
+        std::cout << "Torn last block: " << torn.trialCount() << " trials read, " << torn.tornBytes() << " bytes left out"
+                  << " (expected: 10 trials read, 68 bytes left out)" << std::endl;
+        
+        // A resumed run cuts off what was written after its checkpoint
+        BinaryIO::replaceFile(other, bytes);
+        std::ostringstream state;
+        {
+            TrialFileWriter writer(other, 0);
+            writer.saveState(state);
+            writer.begin(10, 1, 7);
+            TrialRecord record{11, 6, 62, 0.0, 0.0};
+            writer.write(&record, 1);
+            writer.flush();
+        }
+        {
+            TrialFileWriter resumed(other, 0);
+            std::istringstream checkpoint(state.str());
+            resumed.restoreState(checkpoint);
+        }
+        std::cout << "Trials after restoring: " << TrialFileReader(other).trialCount() << " (expected: 11)" << std::endl;
+        
+        // A corrupt block is refused rather than read past its end
+        bytes[bytes.size() - 72] = 'X';
+        BinaryIO::replaceFile(other, bytes);
+        try {
+            TrialFileReader corrupt(other);
+            std::cout << "ERROR: Should have thrown exception for a corrupt block" << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Correctly caught runtime error: " << e.what() << std::endl;
+        }
+        std::remove(path.c_str());
+        std::remove(other.c_str());
+        
+        std::cout << "TrialFile tests completed." << std::endl;
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "BinaryIO.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+// one finished trial, as handed to a TrialSink
+struct TrialRecord {
+    uint64_t trial;               // index within the run
+    uint64_t seed;                // seed of the trial's own generator; replays the trial
+    int openSites;                // open sites when the grid first percolated
+    double meanClusterSize;       // largest cluster excluded
+    double spanningStrength;      // spanning cluster's share of all sites
+};
+
+// Receives every trial of a run in trial order, a chunk at a time, on the
+// thread that constructed PercolationStats; the workers never call it
+class TrialSink {
+public:
+    virtual ~TrialSink() {}
+    
+    // once per run, before any trials: grid size, trials requested and run seed
+    virtual void begin(int n, int trials, uint64_t runSeed) {
+        (void)n;
+        (void)trials;
+        (void)runSeed;
+    }
+    
+    virtual void write(const TrialRecord* records, size_t count) = 0;
+    
+    // everything written so far is out of the sink's buffers (before each checkpoint and at the end)
+    virtual void flush() {}
+    
+    // Checkpoints: after flush(), how much output the sink holds; a resumed
+    // run hands it back before begin() so output from after the checkpoint
+    // is dropped instead of repeated
+    virtual void saveState(std::ostream& out) {
+        (void)out;
+    }
+    
+    virtual void restoreState(std::istream& in) {
+        (void)in;
+    }
+};
+
+// Hands every call on to several sinks, in the order they were added
+class TrialSinks : public TrialSink {
+private:
+    std::vector<TrialSink*> sinks;    // not owned
+
+public:
+    void add(TrialSink* sink) {
+        sinks.push_back(sink);
+    }
+    
+    bool empty() const {
+        return sinks.empty();
+    }
+    
+    void begin(int n, int trials, uint64_t runSeed) override {
+        for (TrialSink* sink : sinks) sink->begin(n, trials, runSeed);
+    }
+    
+    void write(const TrialRecord* records, size_t count) override {
+        for (TrialSink* sink : sinks) sink->write(records, count);
+    }
+    
+    void flush() override {
+        for (TrialSink* sink : sinks) sink->flush();
+    }
+    
+    void saveState(std::ostream& out) override {
+        BinaryIO::write(out, uint32_t(sinks.size()));
+        for (TrialSink* sink : sinks) sink->saveState(out);
+    }
+    
+    // the checkpoint must come from a run with the same outputs
+    void restoreState(std::istream& in) override {
+        if (BinaryIO::read<uint32_t>(in) != sinks.size()) {
+            throw std::invalid_argument("Checkpoint was written with different trial outputs");
+        }
+        for (TrialSink* sink : sinks) sink->restoreState(in);
+    }
+};
@@ -0,0 +1,181 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <string>
+#include <exception>
+#include <stdexcept>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
+
+// Fixed-size group of worker threads, optionally pinned one per core.
+// Pinned workers are spread round-robin over NUMA nodes so every node
+// takes a share of the trials and of the memory bandwidth.
+class WorkerPool {
+private:
+    int threads;
+    bool pin;
+    std::vector<int> cpus;    // core assigned to each worker (-1 if unpinned)
+    std::vector<int> nodes;   // NUMA node each worker ran on
+    
+    // cores this process is allowed to run on
+    static std::vector<int> allowedCpus() {
+        std::vector<int> result;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) result.push_back(cpu);
+            }
+        }
+#endif
+        return result;
+    }
+    
+    // Interleave cores across nodes: node0 core, node1 core, node0 core, ...
+    void assignCpus() {
+        std::vector<int> available = allowedCpus();
+        if (available.empty()) {
+            pin = false;
+            return;
+        }
+        
+        std::vector<std::vector<int>> byNode;
+        for (int cpu : available) {
+            int node = nodeOfCpu(cpu);
+            if (node >= int(byNode.size())) byNode.resize(node + 1);
+            byNode[node].push_back(cpu);
+        }
+        
+        std::vector<int> order;
+        for (size_t i = 0; order.size() < available.size(); i++) {
+            for (auto& nodeCpus : byNode) {
+                if (i < nodeCpus.size()) order.push_back(nodeCpus[i]);
+            }
+        }
+        
+        for (int w = 0; w < threads; w++) {
+            cpus[w] = order[w % order.size()];
+        }
+    }
+
+public:
+    // creates a pool of the given size; pin = bind each worker to one core
+    WorkerPool(int threads, bool pin) : threads(threads), pin(pin) {
+        if (threads <= 0) {
+            throw std::invalid_argument("Number of threads must be positive");
+        }
+        
+        cpus.assign(threads, -1);
+        nodes.assign(threads, 0);
+        if (pin) assignCpus();
+    }
+    
+    int size() const { return threads; }
+    
+    int cpuOf(int worker) const { return cpus[worker]; }
+    
+    int nodeOf(int worker) const { return nodes[worker]; }
+    
+    // number of hardware threads available to this process
+    static int hardwareThreads() {
+        int count = int(allowedCpus().size());
+        if (count == 0) count = int(std::thread::hardware_concurrency());
+        return count > 0 ? count : 1;
+    }
+    
+    // NUMA node owning the core (0 when topology is unknown)
+    static int nodeOfCpu(int cpu) {
+#ifdef __linux__
+        struct stat info;
+        for (int node = 0; node < 64; node++) {
+            std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/node" + std::to_string(node);
+            if (stat(path.c_str(), &info) == 0) return node;
+        }
+#endif
+        return 0;
+    }
+    
+    // core the calling thread is running on right now (-1 if unknown)
+    static int currentCpu() {
+#ifdef __linux__
+        return sched_getcpu();
+#else
+        return -1;
+#endif
+    }
+    
+    // cores the calling thread may currently run on
+    static std::vector<int> currentAffinity() {
+        std::vector<int> result;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) result.push_back(cpu);
+            }
+        }
+#endif
+        return result;
+    }
+    
+    // restrict the calling thread to the given cores; returns false if unsupported
+    static bool setCurrentAffinity(const std::vector<int>& cpuList) {
+#ifdef __linux__
+        if (cpuList.empty()) return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpuList) {
+            CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpuList;
+        return false;
+#endif
+    }
+    
+    // bind the calling thread to a single core; returns false if unsupported
+    static bool pinCurrentThread(int cpu) {
+        return setCurrentAffinity(std::vector<int>{cpu});
+    }
+    
+    // Run task(worker) on every worker and wait for all of them. Anything a
+    // task allocates is first touched by its own thread, hence on its node.
+    // The first exception thrown by a worker is rethrown here.
+    template <typename Task>
+    void run(Task task) {
+        std::vector<std::exception_ptr> errors(threads);
+        auto body = [&](int worker) {
+            try {
+                if (pin) pinCurrentThread(cpus[worker]);
+                int cpu = currentCpu();
+                nodes[worker] = cpu >= 0 ? nodeOfCpu(cpu) : 0;
+                task(worker);
+            } catch (...) {
+                errors[worker] = std::current_exception();
+            }
+        };
+        
+        if (threads == 1 && !pin) {
+            body(0);
+        } else {
+            std::vector<std::thread> workers;
+            workers.reserve(threads);
+            for (int w = 0; w < threads; w++) {
+                workers.emplace_back(body, w);
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+        
+        for (auto& error : errors) {
+            if (error) std::rethrow_exception(error);
+        }
+    }
+};
@@ -1,164 +1,613 @@
 #include "Percolation.hpp"
 #include "PercolationQuickFind.hpp"
 #include "PercolationStat.hpp"
+#include "PercolationBitSliced.hpp"
+#include "BenchmarkRunner.hpp"
+#include "BenchmarkBaseline.hpp"
+#include "FiniteSizeScaling.hpp"
+#include "MultilevelStats.hpp"
+#include "RareEventSplitting.hpp"
+#include "Microbenchmark.hpp"
+#include "PerfCounters.hpp"
 #include "Stopwatch.hpp"
+#include "Tracer.hpp"
+#include "MemoryUsage.hpp"
+#include "ThreadScaling.hpp"
+#include "BinaryIO.hpp"
+#include "TrialFile.hpp"
+#include "AsyncTrialWriter.hpp"
+#include "OpenSequence.hpp"
+#include "SiteMask.hpp"
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <map>
+#include <memory>
 #include <random>
 #include <string>
 
+// set by --trace; stats runs and benchmarks record spans into it
+Tracer* activeTracer = nullptr;
+
+// set by --checkpoint <file>, --resume, --trials-out <file> and --stream <format>[:<file>];
+// apply to the command-line stats run
+std::string checkpointPath;
+bool resumeRun = false;
+std::string trialsOutPath;
+std::string streamFormat;
+std::string streamPath;                // "" = stdout
+std::ostream* streamStdout = nullptr;  // the real stdout while std::cout is sent to stderr
+
 // Quick Find version of PercolationStats for comparison
 class PercolationStatsQuickFind {
 private:
-    std::vector<double> thresholds;
     int n;
     int trials;
-    double sampleMean;
-    double sampleStddev;
-    
-    void calculateStats() {
-        double sum = 0.0;
-        for (double threshold : thresholds) {
-            sum += threshold;
-        }
-        sampleMean = sum / trials;
-        
-        double sumSquaredDiffs = 0.0;
-        for (double threshold : thresholds) {
-            double diff = threshold - sampleMean;
-            sumSquaredDiffs += diff * diff;
-        }
-        sampleStddev = std::sqrt(sumSquaredDiffs / (trials - 1));
-    }
+    StatsAccumulator summary;
+#ifdef PERCOLATION_COUNTERS
+    EngineCounters engine;
+#endif
 
 public:
-    PercolationStatsQuickFind(int n, int trials) : n(n), trials(trials) {
+    // seed 0 draws a fresh seed
+    PercolationStatsQuickFind(int n, int trials, unsigned int seed = 0) : n(n), trials(trials) {
         if (n <= 0 || trials <= 0) {
             throw std::invalid_argument("n and trials must be positive");
         }
         
-        thresholds.reserve(trials);
         std::random_device rd;
-        std::mt19937 gen(rd());
+        std::mt19937 gen(seed != 0 ? seed : rd());
         std::uniform_int_distribution<> dis(0, n - 1);
         
         for (int t = 0; t < trials; t++) {
             PercolationQuickFind perc(n);
             
             while (!perc.percolates()) {
-                int row, col;
-                do {
+                int row = dis(gen);
+                int col = dis(gen);
+                while (perc.isOpen(row, col)) {
+                    PERCOLATION_COUNT(engine.rejectedDraws++);
                     row = dis(gen);
                     col = dis(gen);
-                } while (perc.isOpen(row, col));
+                }
                 
                 perc.open(row, col);
             }
             
             double threshold = static_cast<double>(perc.numberOfOpenSites()) / (n * n);
-            thresholds.push_back(threshold);
+            summary.add(threshold);
+            PERCOLATION_COUNT(engine.merge(perc.counters()));
         }
-        
-        calculateStats();
     }
     
-    double mean() { return sampleMean; }
-    double stddev() { return sampleStddev; }
+    double mean() { return summary.mean(); }
+    double stddev() { return summary.stddev(); }
+#ifdef PERCOLATION_COUNTERS
+    const EngineCounters& engineCounters() const { return engine; }
+#endif
     double confidenceLow() {
-        double margin = 1.96 * sampleStddev / std::sqrt(trials);
-        return sampleMean - margin;
+        double margin = 1.96 * summary.stddev() / std::sqrt(trials);
+        return summary.mean() - margin;
     }
     double confidenceHigh() {
-        double margin = 1.96 * sampleStddev / std::sqrt(trials);
-        return sampleMean + margin;
+        double margin = 1.96 * summary.stddev() / std::sqrt(trials);
+        return summary.mean() + margin;
     }
 };
 
-void runPercolationStats(int n, int trials) {
-    std::cout << "Running PercolationStats with Weighted Quick-Union:" << std::endl;
-    std::cout << "n = " << n << ", trials = " << trials << std::endl;
+void runPercolationStats(int n, int trials, int threads = 1, bool pipelined = false, bool commandLine = false) {
+    std::cout << "Running PercolationStats with Weighted Quick-Union:\n";
+    std::cout << "n = " << n << ", trials = " << trials << ", threads = " << threads
+              << (pipelined ? " (+1 generator)" : "") << '\n';
+    
+    StatsOptions options;
+    options.threads = threads;
+    options.pinThreads = threads > 1;
+    options.pipelined = pipelined;
+    options.countEvents = true;
+    options.phaseTiming = !pipelined;
+    options.tracer = activeTracer;
+    std::unique_ptr<TrialFileWriter> trialFile;
+    std::unique_ptr<AsyncTrialWriter> stream;
+    TrialSinks sinks;
+    if (commandLine) {
+        options.checkpointPath = checkpointPath;
+        options.resume = resumeRun;
+        if (!trialsOutPath.empty()) {
+            trialFile.reset(new TrialFileWriter(trialsOutPath));
+            sinks.add(trialFile.get());
+        }
+        if (!streamFormat.empty()) {
+            TrialStreamFormat format = AsyncTrialWriter::parseFormat(streamFormat);
+            stream.reset(streamPath.empty() ? new AsyncTrialWriter(*streamStdout, format) : new AsyncTrialWriter(streamPath, format));
+            sinks.add(stream.get());
+        }
+        if (!sinks.empty()) options.trialSink = &sinks;
+    }
+    
+    // The unit tests have already touched far more memory than a small run
+    size_t rssBefore = MemoryUsage::currentRssBytes();
+    bool peakReset = MemoryUsage::resetPeak();
+    Stopwatch sw;
+    PercolationStats stats(n, trials, options);
+    double elapsed = sw.elapsedTime();
+    
+    if (commandLine && !checkpointPath.empty()) {
+        std::cout << "checkpoint       = " << checkpointPath;
+        if (stats.trialsResumed() > 0) std::cout << " (resumed at trial " << stats.trialsResumed() << ")";
+        std::cout << '\n';
+    }
+    std::cout << std::fixed << std::setprecision(6);
+    std::cout << "mean()           = " << stats.mean() << '\n';
+    std::cout << "stddev()         = " << stats.stddev() << '\n';
+    std::cout << "confidenceLow()  = " << stats.confidenceLow() << '\n';
+    std::cout << "confidenceHigh() = " << stats.confidenceHigh() << '\n';
+    std::cout << "median           = " << stats.quantile(0.5) << '\n';
+    std::cout << "2.5% / 97.5%     = " << stats.quantile(0.025) << " / " << stats.quantile(0.975) << '\n';
+    std::cout << "cluster size     = " << stats.meanClusterSize() << " (mean, largest excluded)\n";
+    std::cout << "spanning P       = " << stats.spanningStrength() << '\n';
+    std::cout << "elapsed time     = " << elapsed << '\n';
+    if (trialFile) {
+        std::cout << "trial file       = " << trialsOutPath << " (" << trialFile->trialsWritten() << " trials appended)\n";
+    }
+    std::cout << "grid memory      = " << MemoryUsage::format(double(Percolation::bytesFor(n))) << " per worker ("
+              << std::setprecision(2) << double(Percolation::bytesFor(n)) / (double(n) * n) << " B/site)\n";
+    std::cout << "peak RSS         = " << MemoryUsage::format(double(MemoryUsage::peakRssBytes()))
+              << (peakReset ? " during the run (" + MemoryUsage::format(double(rssBefore)) + " resident before it)"
+                            : " (whole process, unit tests included)") << '\n';
+    std::cout << std::setprecision(6);
+    std::cout << "per trial        : ";
+    stats.eventsPerTrial().print(std::cout);
+#ifdef PERCOLATION_COUNTERS
+    stats.engineCounters().print(std::cout, stats.trialsRun());
+#endif
+    if (!pipelined) {
+        std::cout << "time per phase:\n";
+        stats.printPhaseTimes(std::cout);
+    }
+    if (threads > 1) {
+        std::cout << "throughput per NUMA node:\n";
+        stats.printNodeThroughput(std::cout);
+    }
+    if (pipelined) {
+        std::cout << "pipeline stage occupancy:\n";
+        stats.printPipelineReport(std::cout);
+    }
+    std::cout << std::endl;
+}
+
+void runBootstrap(int n, int trials, int threads, int replicates) {
+    std::cout << "Running PercolationStats with bootstrap confidence intervals:" << std::endl;
+    std::cout << "n = " << n << ", trials = " << trials << ", threads = " << threads
+              << ", replicates = " << replicates << std::endl;
+    
+    StatsOptions options;
+    options.threads = threads;
+    options.pinThreads = threads > 1;
+    options.retainThresholds = true;
     
     Stopwatch sw;
-    PercolationStats stats(n, trials);
+    PercolationStats stats(n, trials, options);
     double elapsed = sw.elapsedTime();
     
+    Stopwatch swBootstrap;
+    BootstrapInterval interval = stats.bootstrap(replicates);
+    double elapsedBootstrap = swBootstrap.elapsedTime();
+    
     std::cout << std::fixed << std::setprecision(6);
     std::cout << "mean()           = " << stats.mean() << std::endl;
-    std::cout << "stddev()         = " << stats.stddev() << std::endl;
-    std::cout << "confidenceLow()  = " << stats.confidenceLow() << std::endl;
-    std::cout << "confidenceHigh() = " << stats.confidenceHigh() << std::endl;
+    std::cout << "normal 95% CI    = [" << stats.confidenceLow() << ", " << stats.confidenceHigh() << "]" << std::endl;
+    std::cout << "percentile 95%   = [" << interval.percentileLow << ", " << interval.percentileHigh << "]" << std::endl;
+    std::cout << "BCa 95%          = [" << interval.bcaLow << ", " << interval.bcaHigh << "]" << std::endl;
+    std::cout << "elapsed time     = " << elapsed << std::endl;
+    std::cout << "bootstrap time   = " << elapsedBootstrap << std::endl;
+    std::cout << std::endl;
+}
+
+void runFiniteSizeScaling(int nMin, int nMax, double budgetSeconds, int threads) {
+    std::cout << "Running finite-size-scaling extrapolation:" << std::endl;
+    std::cout << "n = " << nMin << ".." << nMax << " (x2), budget = " << budgetSeconds
+              << "s, threads = " << threads << std::endl;
+    
+    StatsOptions options;
+    options.threads = threads;
+    options.pinThreads = threads > 1;
+    
+    Stopwatch sw;
+    FiniteSizeScaling sweep(nMin, nMax, 2.0, 4.0 / 3.0, options);
+    sweep.run(budgetSeconds);
+    double elapsed = sw.elapsedTime();
+    
+    sweep.print(std::cout);
+    std::cout << "infinite lattice = 0.592746" << std::endl;
+    std::cout << "elapsed time     = " << elapsed << std::endl;
+    std::cout << std::endl;
+}
+
+void runMultilevel(int n, int levels, double halfWidth, int threads) {
+    std::cout << "Running multilevel Monte Carlo:" << std::endl;
+    std::cout << "n = " << n << ", levels = " << levels << ", target half-width = " << halfWidth
+              << ", threads = " << threads << std::endl;
+    
+    MultilevelStats mlmc(n, levels, threads);
+    mlmc.run(halfWidth);
+    mlmc.print(std::cout);
+    
+    std::cout << "base grid        = " << mlmc.baseSize() << std::endl;
+    std::cout << "speedup vs plain = " << mlmc.plainCpuSeconds() / mlmc.cpuSeconds() << "x" << std::endl;
+    std::cout << std::endl;
+}
+
+void runTailProbability(int n, double p, int particles, int repetitions, int threads) {
+    std::cout << "Running rare-event splitting for P(percolates):" << std::endl;
+    std::cout << "n = " << n << ", p = " << p << ", particles = " << particles
+              << ", repetitions = " << repetitions << ", threads = " << threads << std::endl;
+    
+    Stopwatch sw;
+    TailEstimate tail = RareEventSplitting(n, p, particles, threads).estimate(repetitions);
+    double elapsed = sw.elapsedTime();
+    
+    std::cout << std::scientific << std::setprecision(4);
+    std::cout << "P(percolates)    = " << tail.probability << std::endl;
+    std::cout << std::fixed << std::setprecision(6);
+    std::cout << "relative error   = " << tail.relativeError << std::endl;
     std::cout << "elapsed time     = " << elapsed << std::endl;
     std::cout << std::endl;
 }
 
+// perf_event_open counters per trial for each engine (EngineCounters are the compile-time ones)
+void runHardwareCounters(int n, int trials) {
+    std::cout << "Hardware counters per trial, n = " << n << ", trials = " << trials << ":" << std::endl;
+    
+    BenchmarkOptions options;
+    options.countEvents = true;
+    options.maxRuns = 5;
+    BenchmarkRunner runner(options);
+    
+    BenchmarkResult wqu = runner.run("Weighted Quick-Union", [&]() { PercolationStats stats(n, trials); });
+    std::cout << std::left << std::setw(22) << "Weighted Quick-Union" << std::right;
+    wqu.events.per(trials).print(std::cout);
+    
+    if (n <= 200) {
+#ifdef PERCOLATION_COUNTERS
+        EngineCounters quickFind;
+#endif
+        BenchmarkResult qf = runner.run("Quick-Find", [&]() {
+            PercolationStatsQuickFind stats(n, trials);
+            PERCOLATION_COUNT(quickFind = stats.engineCounters());
+        });
+        std::cout << std::left << std::setw(22) << "Quick-Find" << std::right;
+        qf.events.per(trials).print(std::cout);
+#ifdef PERCOLATION_COUNTERS
+        // engine counters of the last timed run
+        quickFind.print(std::cout, trials);
+#endif
+    }
+    
+    BenchmarkResult bits = runner.run("Bit-sliced", [&]() {
+        PercolationBitSliced::percolationProbability(n, 0.592746, trials);
+    });
+    std::cout << std::left << std::setw(22) << "Bit-sliced (p=p_c)" << std::right;
+    bits.events.per(trials).print(std::cout);
+    std::cout << std::endl;
+}
+
+// Fixed-seed benchmark suite behind the baseline and compare modes
+std::vector<BaselineRecord> runBaselineSuite(const std::vector<int>& sizes) {
+    const int trials = 100;
+    const uint64_t seed = 20240901;
+    
+    BenchmarkOptions options;
+    options.minRuns = 7;
+    options.maxRuns = 15;
+    options.targetRelativeError = 0.01;
+    options.countEvents = true;
+    options.tracer = activeTracer;
+    BenchmarkRunner runner(options);
+    
+    StatsOptions statsOptions;
+    statsOptions.seed = seed;
+    
+    std::vector<BaselineRecord> records;
+    for (int n : sizes) {
+        BenchmarkResult wqu = runner.run("Weighted Quick-Union", [&]() { PercolationStats stats(n, trials, statsOptions); });
+        BenchmarkRunner::print(std::cout, wqu);
+        records.push_back(BenchmarkBaseline::record("Weighted Quick-Union", n, trials, seed, wqu));
+        
+        if (n <= 100) {
+            BenchmarkResult qf = runner.run("Quick-Find", [&]() { PercolationStatsQuickFind stats(n, trials, (unsigned int)seed); });
+            BenchmarkRunner::print(std::cout, qf);
+            records.push_back(BenchmarkBaseline::record("Quick-Find", n, trials, seed, qf));
+        }
+        
+        BenchmarkResult bits = runner.run("Bit-sliced (p=p_c)", [&]() {
+            PercolationBitSliced::percolationProbability(n, 0.592746, 64 * trials, seed);
+        });
+        BenchmarkRunner::print(std::cout, bits);
+        records.push_back(BenchmarkBaseline::record("Bit-sliced (p=p_c)", n, 64 * trials, seed, bits));
+    }
+    std::cout << std::endl;
+    return records;
+}
+
+void runThreadScaling(int n, int trialsPerThread, int maxThreads) {
+    ThreadScaling scaling(n, trialsPerThread, maxThreads);
+    std::vector<int> counts = ThreadScaling::threadCounts(maxThreads > 0 ? maxThreads : WorkerPool::hardwareThreads());
+    std::cout << "Thread scaling, n = " << n << ", " << trialsPerThread << " trials per thread, up to "
+              << counts.back() << " threads (grid " << MemoryUsage::format(double(Percolation::bytesFor(n))) << "):" << std::endl;
+    if (counts.back() > WorkerPool::hardwareThreads()) {
+        std::cout << "(oversubscribed: only " << WorkerPool::hardwareThreads() << " hardware threads available)" << std::endl;
+    }
+    
+    std::vector<ThreadScalingPoint> strong = scaling.strong();
+    ThreadScaling::print(std::cout, "Strong scaling (fixed total trials)", strong);
+    std::cout << std::endl;
+    std::vector<ThreadScalingPoint> weak = scaling.weak();
+    ThreadScaling::print(std::cout, "Weak scaling (fixed trials per thread)", weak);
+    scaling.printSaturation(std::cout, weak);
+    std::cout << std::endl;
+}
+
+// Summary of a trial file written with --trials-out, read in place from the mapping
+void runTrialFileSummary(const std::string& path) {
+    Stopwatch sw;
+    TrialFileReader reader(path);
+    StatsAccumulator thresholds;
+    std::map<int, long long> trialsPerSize;
+    size_t bytes = 0;
+    const TrialBlock* lowBlock = nullptr;
+    const TrialBlock* highBlock = nullptr;
+    size_t low = 0, high = 0;
+    for (const auto& block : reader.blocks()) {
+        for (size_t i = 0; i < block.count; i++) {
+            double threshold = block.threshold(i);
+            thresholds.add(threshold);
+            if (!lowBlock || threshold < lowBlock->threshold(low)) {
+                lowBlock = &block;
+                low = i;
+            }
+            if (!highBlock || threshold > highBlock->threshold(high)) {
+                highBlock = &block;
+                high = i;
+            }
+        }
+        trialsPerSize[block.n] += (long long)block.count;
+        bytes += block.count * sizeof(int32_t);
+    }
+    double elapsed = sw.elapsedTime();
+    
+    std::cout << path << ": " << reader.blocks().size() << " blocks, " << reader.trialCount() << " trials" << std::endl;
+    for (const auto& entry : trialsPerSize) {
+        std::cout << "  n = " << entry.first << ": " << entry.second << " trials" << std::endl;
+    }
+    if (thresholds.size() > 0) {
+        std::cout << std::fixed << std::setprecision(6);
+        std::cout << "mean threshold   = " << thresholds.mean() << std::endl;
+        std::cout << "stddev           = " << (thresholds.size() > 1 ? thresholds.stddev() : 0.0) << std::endl;
+        std::cout << "range            = [" << thresholds.min() << ", " << thresholds.max() << "]" << std::endl;
+        // Seeds of the extremes, for `record <n> <seed> <file>`
+        std::cout << "lowest           = trial " << lowBlock->trial[low] << " (n = " << lowBlock->n
+                  << ", seed " << lowBlock->seed[low] << ")" << std::endl;
+        std::cout << "highest          = trial " << highBlock->trial[high] << " (n = " << highBlock->n
+                  << ", seed " << highBlock->seed[high] << ")" << std::endl;
+    }
+    std::cout << "open-site column read in " << std::setprecision(4) << elapsed << " s ("
+              << MemoryUsage::format(elapsed > 0 ? bytes / elapsed : 0.0) << "/s)" << std::endl;
+}
+
+// Record the open sequence of the trial seeded with `seed` to a trace file
+void runRecordSequence(int n, uint64_t seed, const std::string& path) {
+    OpenSequence sequence = OpenSequence::record(n, seed);
+    sequence.save(path);
+    size_t bytes = sequence.encode().size();
+    std::cout << "Recorded " << sequence.sites().size() << " opens (threshold " << std::fixed << std::setprecision(6)
+              << sequence.sites().size() / (double(n) * n) << ") to " << path << ": " << bytes << " bytes, "
+              << std::setprecision(2) << double(bytes) / sequence.sites().size() << " bytes per step" << std::endl;
+}
+
+// Replay a trace through both engines, verified, then time them on it
+void runReplaySequence(const std::string& path) {
+    OpenSequence sequence = OpenSequence::load(path);
+    int n = sequence.size();
+    std::cout << "Replaying " << sequence.sites().size() << " opens on a " << n << "x" << n
+              << " grid (seed " << sequence.recordedSeed() << ")" << std::endl;
+    
+    ReplayResult weighted = sequence.replay<Percolation>();
+    ReplayResult quick = sequence.replay<PercolationQuickFind>();
+    std::cout << "verified         = percolates at step " << weighted.percolatedAt << " in both engines, full sites "
+              << (weighted.fullHash == quick.fullHash ? "identical" : "DIFFERENT") << std::endl;
+    
+    // Quick-find replays are quadratic; cap the repeats at half a minute per engine
+    BenchmarkOptions benchOptions;
+    benchOptions.maxSeconds = 30.0;
+    benchOptions.tracer = activeTracer;
+    BenchmarkRunner runner(benchOptions);
+    BenchmarkResult wqu = runner.run("replay weighted quick-union", [&]() {
+        Percolation perc(n);
+        sequence.replayUnchecked(perc);
+    });
+    BenchmarkResult qf = runner.run("replay quick-find", [&]() {
+        PercolationQuickFind perc(n);
+        sequence.replayUnchecked(perc);
+    });
+    double steps = double(sequence.sites().size());
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Weighted QU      = " << 1e9 * wqu.median / steps << " ns/step (median of " << wqu.runs << " runs)" << std::endl;
+    std::cout << "Quick-Find       = " << 1e9 * qf.median / steps << " ns/step (median of " << qf.runs << " runs)" << std::endl;
+}
+
+// Label a mapped site mask in one pass; optionally write its full sites as a PBM
+void runSiteMask(const SiteMask& mask, const std::string& fullPath) {
+    int w = mask.width(), h = mask.height();
+    std::cout << "Mask " << w << "x" << h << " (" << MemoryUsage::format(double((w + 7) / 8) * h) << " packed)" << std::endl;
+    
+    Stopwatch sw;
+    MaskResult result = mask.percolates();
+    double streamed = sw.elapsedTime();
+    std::cout << "percolates       = " << (result.percolates ? "true" : "false") << std::endl;
+    std::cout << "open sites       = " << result.openSites << std::fixed << std::setprecision(6)
+              << " (" << result.openSites / (double(w) * h) << ")" << std::endl;
+    std::cout << "row-streamed     = " << std::setprecision(4) << streamed << " s, "
+              << std::setprecision(1) << 1e9 * streamed / (double(w) * h) << " ns/site" << std::endl;
+    
+    if (!fullPath.empty()) {
+        std::vector<uint8_t> full;
+        sw.reset();
+        MaskResult labeled = mask.fullSites(full);
+        double elapsed = sw.elapsedTime();
+        SiteMask::writePbm(fullPath, w, h, full);
+        std::cout << "full sites       = " << labeled.fullSites << " written to " << fullPath << " in "
+                  << std::setprecision(4) << elapsed << " s" << std::endl;
+    }
+    
+    // The same grid through open() site by site, where the engine can hold it
+    if (w == h && w <= 4096) {
+        sw.reset();
+        Percolation perc(w);
+        for (int row = 0; row < h; row++) {
+            for (int col = 0; col < w; col++) {
+                if (mask.isOpen(row, col)) perc.open(row, col);
+            }
+        }
+        bool percolates = perc.percolates();
+        double elapsed = sw.elapsedTime();
+        std::cout << "open() per site  = " << std::setprecision(4) << elapsed << " s, percolates "
+                  << (percolates == result.percolates ? "agrees" : "DIFFERS") << std::endl;
+    }
+}
+
+void runPercolationProbability(int n, double p, int trials) {
+    std::cout << "Running bit-sliced canonical ensemble:" << std::endl;
+    std::cout << "n = " << n << ", p = " << p << ", trials = " << trials << std::endl;
+    
+    Stopwatch sw;
+    double probability = PercolationBitSliced::percolationProbability(n, p, trials);
+    double elapsed = sw.elapsedTime();
+    
+    std::cout << std::fixed << std::setprecision(6);
+    std::cout << "P(percolates)    = " << probability << std::endl;
+    std::cout << "elapsed time     = " << elapsed << std::endl;
+    std::cout << std::endl;
+}
+
+void interleavingComparison(int trials) {
+    std::cout << "=== INTERLEAVED TRIAL THROUGHPUT ===" << std::endl;
+    std::cout << "Trials per second on one thread, K trials advanced round-robin" << std::endl;
+    std::cout << std::endl;
+    
+    std::vector<int> lanes = {1, 2, 4, 8};
+    
+    std::cout << std::setw(8) << "n";
+    for (int k : lanes) {
+        std::cout << std::setw(12) << ("K=" + std::to_string(k));
+    }
+    std::cout << std::setw(12) << "best gain" << std::endl;
+    std::cout << std::string(8 + 12 * (lanes.size() + 1), '-') << std::endl;
+    
+    std::cout << std::fixed << std::setprecision(3);
+    for (int n = 1000; n <= 5000; n += 1000) {
+        std::cout << std::setw(8) << n;
+        double baseline = 0.0, best = 0.0;
+        for (int k : lanes) {
+            StatsOptions options;
+            options.interleave = k;
+            
+            Stopwatch sw;
+            PercolationStats stats(n, trials, options);
+            double throughput = trials / sw.elapsedTime();
+            
+            if (k == 1) baseline = throughput;
+            best = std::max(best, throughput);
+            std::cout << std::setw(12) << throughput << std::flush;
+        }
+        std::cout << std::setw(11) << best / baseline << "x" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
 void performanceComparison() {
     std::cout << "=== PERFORMANCE COMPARISON ===" << std::endl;
     std::cout << "Comparing Quick-Find vs Weighted Quick-Union" << std::endl;
+    std::cout << "(pinned, 1 warmup run, median of repeated runs)" << std::endl;
     std::cout << std::endl;
+    bool peakReset = MemoryUsage::resetPeak();
     
     // Test different grid sizes
     std::vector<int> testSizes = {10, 20, 50, 100, 150, 200};
     const int trials = 100;
     const double timeLimit = 60.0; // 1 minute limit
     
+    BenchmarkOptions tableOptions;
+    tableOptions.timeLimit = timeLimit;
+    tableOptions.tracer = activeTracer;
+    BenchmarkRunner runner(tableOptions);
+    
     std::cout << std::setw(8) << "n" 
               << std::setw(15) << "Quick-Find (s)"
+              << std::setw(10) << "MAD"
               << std::setw(20) << "Weighted QU (s)"
-              << std::setw(12) << "Speedup" << std::endl;
-    std::cout << std::string(55, '-') << std::endl;
+              << std::setw(10) << "MAD"
+              << std::setw(12) << "Speedup"
+              << std::setw(12) << "QF B/site"
+              << std::setw(12) << "WQU B/site" << std::endl;
+    std::cout << std::string(99, '-') << std::endl;
     
     for (int n : testSizes) {
-        std::cout << std::setw(8) << n;
+        std::cout << std::setw(8) << n << std::flush;
         
-        // Test Quick-Find
-        Stopwatch swQF;
         try {
-            PercolationStatsQuickFind statsQF(n, trials);
-            double timeQF = swQF.elapsedTime();
-            
-            if (timeQF > timeLimit) {
-                std::cout << std::setw(15) << ">60.0" << std::setw(20) << "-" << std::setw(12) << "-" << std::endl;
+            // Test Quick-Find
+            BenchmarkResult qf = runner.run("Quick-Find", [&]() { PercolationStatsQuickFind statsQF(n, trials); });
+            if (qf.timedOut) {
+                std::cout << std::setw(15) << ">60.0" << std::setw(10) << "-" << std::setw(20) << "-"
+                          << std::setw(10) << "-" << std::setw(12) << "-" << std::endl;
                 std::cout << "Quick-Find exceeded time limit at n=" << n << std::endl;
                 break;
             }
             
             // Test Weighted Quick-Union
-            Stopwatch swWQU;
-            PercolationStats statsWQU(n, trials);
-            double timeWQU = swWQU.elapsedTime();
+            BenchmarkResult wqu = runner.run("Weighted Quick-Union", [&]() { PercolationStats statsWQU(n, trials); });
             
-            double speedup = timeQF / timeWQU;
+            double speedup = qf.median / wqu.median;
             
             std::cout << std::fixed << std::setprecision(3);
-            std::cout << std::setw(15) << timeQF
-                      << std::setw(20) << timeWQU
-                      << std::setw(12) << speedup << "x" << std::endl;
-                      
+            std::cout << std::setw(15) << qf.median
+                      << std::setw(10) << qf.mad
+                      << std::setw(20) << wqu.median
+                      << std::setw(10) << wqu.mad
+                      << std::setw(12) << speedup << "x"
+                      << std::setprecision(2)
+                      << std::setw(11) << PercolationQuickFind(n).bytesPerSite()
+                      << std::setw(12) << Percolation(n).bytesPerSite() << std::endl;
+        
         } catch (const std::exception& e) {
-            std::cout << std::setw(15) << "TIMEOUT" << std::setw(20) << "-" << std::setw(12) << "-" << std::endl;
+            std::cout << std::setw(15) << "TIMEOUT" << std::setw(10) << "-" << std::setw(20) << "-"
+                      << std::setw(10) << "-" << std::setw(12) << "-" << std::endl;
             break;
         }
     }
     
     std::cout << std::endl;
     
-    // Find maximum n for each algorithm within time limit
+    // Find maximum n for each algorithm within time limit. Each size is a
+    // single pinned run: repeating minute-long jobs would take hours.
     std::cout << "Finding maximum n within 60 seconds for 100 trials:" << std::endl;
     
+    BenchmarkOptions searchOptions;
+    searchOptions.warmupRuns = 0;
+    searchOptions.minRuns = 1;
+    searchOptions.maxRuns = 1;
+    searchOptions.timeLimit = timeLimit;
+    BenchmarkRunner searchRunner(searchOptions);
+    
     // Quick-Find maximum
     int maxNQuickFind = 0;
     for (int n = 50; n <= 1000; n += 50) {
-        Stopwatch sw;
         try {
-            PercolationStatsQuickFind stats(n, trials);
-            double elapsed = sw.elapsedTime();
-            if (elapsed <= timeLimit) {
-                maxNQuickFind = n;
-                std::cout << "Quick-Find n=" << n << " completed in " << elapsed << "s" << std::endl;
-            } else {
-                break;
-            }
+            BenchmarkResult result = searchRunner.run("Quick-Find", [&]() { PercolationStatsQuickFind stats(n, trials); });
+            if (result.timedOut) break;
+            maxNQuickFind = n;
+            std::cout << "Quick-Find n=" << n << " completed in " << result.median << "s" << std::endl;
         } catch (...) {
             break;
         }
@@ -167,16 +616,11 @@ void performanceComparison() {
     // Weighted Quick-Union maximum
     int maxNWeightedQU = 0;
     for (int n = 100; n <= 2000; n += 100) {
-        Stopwatch sw;
         try {
-            PercolationStats stats(n, trials);
-            double elapsed = sw.elapsedTime();
-            if (elapsed <= timeLimit) {
-                maxNWeightedQU = n;
-                std::cout << "Weighted Quick-Union n=" << n << " completed in " << elapsed << "s" << std::endl;
-            } else {
-                break;
-            }
+            BenchmarkResult result = searchRunner.run("Weighted Quick-Union", [&]() { PercolationStats stats(n, trials); });
+            if (result.timedOut) break;
+            maxNWeightedQU = n;
+            std::cout << "Weighted Quick-Union n=" << n << " completed in " << result.median << "s" << std::endl;
         } catch (...) {
             break;
         }
@@ -187,9 +631,122 @@ void performanceComparison() {
     std::cout << "Maximum n for Quick-Find (within 60s): " << maxNQuickFind << std::endl;
     std::cout << "Maximum n for Weighted Quick-Union (within 60s): " << maxNWeightedQU << std::endl;
     std::cout << "Performance improvement: " << (double)maxNWeightedQU / maxNQuickFind << "x" << std::endl;
+    
+    // One grid per worker is what memory has to hold; n is capped where
+    // n * n still fits the engines' int site indices
+    const int indexLimit = 46340;
+    std::cout << std::endl;
+    std::cout << "Maximum n for one grid within a memory budget:" << std::endl;
+    std::cout << std::setw(10) << "budget" << std::setw(14) << "Quick-Find" << std::setw(14) << "Weighted QU"
+              << std::setw(18) << "Bit-sliced (x64)" << std::endl;
+    for (double gigabytes : {1.0, 8.0, 64.0}) {
+        double budget = gigabytes * (1 << 30);
+        std::cout << std::setw(7) << std::setprecision(0) << gigabytes << " GB"
+                  << std::setw(14) << MemoryUsage::largestGrid(PercolationQuickFind::bytesFor, budget, indexLimit)
+                  << std::setw(14) << MemoryUsage::largestGrid(Percolation::bytesFor, budget, indexLimit)
+                  << std::setw(18) << MemoryUsage::largestGrid(PercolationBitSliced::bytesFor, budget, indexLimit) << std::endl;
+    }
+    std::cout << "(" << indexLimit << " is the int index limit)" << std::endl;
+    std::cout << "Peak RSS: " << MemoryUsage::format(double(MemoryUsage::peakRssBytes()))
+              << (peakReset ? " during the comparison" : " (whole process, unit tests included)") << std::endl;
+}
+
+// Runs a mode that reads a file: a missing or corrupt file is reported on
+// stderr with exit status 1 instead of aborting through std::terminate.
+// With a usage line, bad arguments (std::stoi, invalid sizes) print it and exit 2
+template <typename Mode>
+int reportingErrors(Mode mode, const char* usage = nullptr) {
+    try {
+        mode();
+        return 0;
+    } catch (const std::logic_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        if (!usage) return 1;
+        std::cerr << "Usage: " << usage << std::endl;
+        return 2;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
 }
 
+// With --stream and no file, stdout carries only the stream: std::cout (the
+// banner, unit tests and summaries) goes to stderr until main returns
+struct StdoutForStream {
+    std::unique_ptr<std::ostream> out;
+    std::streambuf* saved = nullptr;
+    
+    void take() {
+        saved = std::cout.rdbuf();
+        out.reset(new std::ostream(saved));
+        std::cout.rdbuf(std::cerr.rdbuf());
+        streamStdout = out.get();
+    }
+    
+    ~StdoutForStream() {
+        if (saved) std::cout.rdbuf(saved);
+    }
+};
+
+// Writes the trace when main returns, whichever mode ran
+struct TraceAtExit {
+    std::unique_ptr<Tracer> tracer;
+    std::string path;
+    
+    ~TraceAtExit() {
+        if (!tracer) return;
+        try {
+            tracer->write(path);
+            std::cout << "Trace (" << tracer->eventCount() << " spans) written to " << path << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+};
+
 int main(int argc, char* argv[]) {
+    // --trace <file>, --checkpoint <file>, --resume, --trials-out <file> and
+    // --stream <format>[:<file>] may appear anywhere;
+    // the remaining arguments select the mode
+    StdoutForStream stdoutForStream;       // restored after the trace message
+    TraceAtExit trace;
+    std::vector<char*> args(argv, argv + argc);
+    for (size_t i = 1; i < args.size();) {
+        std::string arg = args[i];
+        if (arg == "--trace" && i + 1 < args.size()) {
+            trace.path = args[i + 1];
+            trace.tracer.reset(new Tracer());
+            activeTracer = trace.tracer.get();
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if (arg == "--checkpoint" && i + 1 < args.size()) {
+            checkpointPath = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if (arg == "--trials-out" && i + 1 < args.size()) {
+            trialsOutPath = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if (arg == "--stream" && i + 1 < args.size()) {
+            std::string spec = args[i + 1];
+            size_t colon = spec.find(':');
+            streamFormat = spec.substr(0, colon);
+            streamPath = colon == std::string::npos ? "" : spec.substr(colon + 1);
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if (arg == "--resume") {
+            resumeRun = true;
+            args.erase(args.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    if (resumeRun && checkpointPath.empty()) {
+        std::cerr << "--resume needs --checkpoint <file>" << std::endl;
+        return 1;
+    }
+    if (!streamFormat.empty() && streamPath.empty()) {
+        stdoutForStream.take();
+    }
+    argc = int(args.size());
+    argv = args.data();
+    
     std::cout << "CSE247 Assignment #1 - Percolation Threshold Estimation" << std::endl;
     std::cout << "=========================================================" << std::endl;
     std::cout << std::endl;
@@ -200,14 +757,192 @@ int main(int argc, char* argv[]) {
     std::cout << std::endl;
     PercolationStats::test();
     std::cout << std::endl;
+    PercolationBitSliced::test();
+    std::cout << std::endl;
+    RingBuffer<int>::test();
+    std::cout << std::endl;
+    StatsAccumulator::test();
+    std::cout << std::endl;
+    QuantileSketch::test();
+    std::cout << std::endl;
+    Bootstrap::test();
+    std::cout << std::endl;
+    FiniteSizeScaling::test();
+    std::cout << std::endl;
+    MultilevelStats::test();
+    std::cout << std::endl;
+    RareEventSplitting::test();
+    std::cout << std::endl;
+    Microbenchmark::test();
+    std::cout << std::endl;
+    PerfCounters::test();
+    std::cout << std::endl;
+    BenchmarkBaseline::test();
+    std::cout << std::endl;
+    EngineCounters::test();
+    std::cout << std::endl;
+    BenchmarkRunner::test();
+    std::cout << std::endl;
+    PhaseTimes::test();
+    std::cout << std::endl;
+    Tracer::test();
+    std::cout << std::endl;
+    MemoryUsage::test();
+    std::cout << std::endl;
+    ThreadScaling::test();
+    std::cout << std::endl;
+    BinaryIO::test();
+    std::cout << std::endl;
+    TrialFileReader::test();
+    std::cout << std::endl;
+    AsyncTrialWriter::test();
+    std::cout << std::endl;
+    OpenSequence::test();
+    std::cout << std::endl;
+    SiteMask::test();
+    std::cout << std::endl;
     
     // Check command line arguments
-    if (argc == 3) {
+    if (argc == 5 && std::string(argv[1]) == "probability") {
+        int n = std::stoi(argv[2]);
+        double p = std::stod(argv[3]);
+        int trials = std::stoi(argv[4]);
+        
+        std::cout << "=== FIXED-p PERCOLATION PROBABILITY ===" << std::endl;
+        runPercolationProbability(n, p, trials);
+        return 0;
+    } else if ((argc == 2 || argc == 3) && std::string(argv[1]) == "interleave") {
+        int trials = argc == 3 ? std::stoi(argv[2]) : 16;
+        interleavingComparison(trials);
+        return 0;
+    } else if ((argc == 4 || argc == 5 || argc == 6) && std::string(argv[1]) == "bootstrap") {
+        int n = std::stoi(argv[2]);
+        int trials = std::stoi(argv[3]);
+        int threads = argc >= 5 ? std::stoi(argv[4]) : 1;
+        int replicates = argc == 6 ? std::stoi(argv[5]) : 1000;
+        
+        std::cout << "=== BOOTSTRAP CONFIDENCE INTERVALS ===" << std::endl;
+        runBootstrap(n, trials, threads, replicates);
+        return 0;
+    } else if ((argc == 5 || argc == 6) && std::string(argv[1]) == "scaling") {
+        int nMin = std::stoi(argv[2]);
+        int nMax = std::stoi(argv[3]);
+        double budget = std::stod(argv[4]);
+        int threads = argc == 6 ? std::stoi(argv[5]) : 1;
+        
+        std::cout << "=== FINITE-SIZE SCALING ===" << std::endl;
+        runFiniteSizeScaling(nMin, nMax, budget, threads);
+        return 0;
+    } else if ((argc == 5 || argc == 6) && std::string(argv[1]) == "multilevel") {
+        int n = std::stoi(argv[2]);
+        int levels = std::stoi(argv[3]);
+        double halfWidth = std::stod(argv[4]);
+        int threads = argc == 6 ? std::stoi(argv[5]) : 1;
+        
+        std::cout << "=== MULTILEVEL MONTE CARLO ===" << std::endl;
+        runMultilevel(n, levels, halfWidth, threads);
+        return 0;
+    } else if (argc >= 4 && argc <= 7 && std::string(argv[1]) == "tail") {
+        int n = std::stoi(argv[2]);
+        double p = std::stod(argv[3]);
+        int particles = argc >= 5 ? std::stoi(argv[4]) : 1000;
+        int repetitions = argc >= 6 ? std::stoi(argv[5]) : 10;
+        int threads = argc == 7 ? std::stoi(argv[6]) : 1;
+        
+        std::cout << "=== RARE-EVENT SPLITTING ===" << std::endl;
+        runTailProbability(n, p, particles, repetitions, threads);
+        return 0;
+    } else if (argc >= 2 && std::string(argv[1]) == "microbench") {
+        std::vector<int> sizes;
+        for (int i = 2; i < argc; i++) {
+            sizes.push_back(std::stoi(argv[i]));
+        }
+        if (sizes.empty()) sizes = {64, 256, 1024};
+        
+        std::cout << "=== MICROBENCHMARKS ===" << std::endl;
+        std::cout << "(median ns per operation over 7 repetitions of 4096-operation batches)" << std::endl;
+        Microbenchmark::print(std::cout, Microbenchmark().run(sizes, {0.25, 0.5, 0.59, 0.75}));
+        return 0;
+    } else if (argc >= 3 && (std::string(argv[1]) == "baseline" || std::string(argv[1]) == "compare")) {
+        std::vector<int> sizes;
+        for (int i = 3; i < argc; i++) {
+            sizes.push_back(std::stoi(argv[i]));
+        }
+        if (sizes.empty()) sizes = {50, 200};
+        
+        std::cout << "=== BENCHMARK " << (std::string(argv[1]) == "baseline" ? "BASELINE" : "COMPARISON") << " ===" << std::endl;
+        if (std::string(argv[1]) == "baseline") {
+            std::vector<BaselineRecord> records = runBaselineSuite(sizes);
+            TraceSpan span(activeTracer ? activeTracer->thread("main") : nullptr, "write baseline", "io");
+            BenchmarkBaseline::append(argv[2], records);
+            std::cout << "Appended to " << argv[2] << std::endl;
+            return 0;
+        }
+        std::vector<BaselineRecord> baseline = BenchmarkBaseline::load(argv[2]);
+        std::vector<BaselineComparison> comparisons = BenchmarkBaseline().compare(baseline, runBaselineSuite(sizes));
+        BenchmarkBaseline::print(std::cout, comparisons);
+        return BenchmarkBaseline::anyRegression(comparisons) ? 1 : 0;
+    } else if (argc == 5 && std::string(argv[1]) == "record") {
+        std::cout << "=== RECORD OPEN SEQUENCE ===" << std::endl;
+        return reportingErrors([&]() { runRecordSequence(std::stoi(argv[2]), std::stoull(argv[3]), argv[4]); });
+    } else if (argc == 3 && std::string(argv[1]) == "replay") {
+        std::cout << "=== REPLAY OPEN SEQUENCE ===" << std::endl;
+        return reportingErrors([&]() { runReplaySequence(argv[2]); });
+    } else if (argc >= 3 && argc <= 6 && std::string(argv[1]) == "mask") {
+        // mask <file.pbm> [full.pbm]  or  mask <file.raw> <width> <height> [full.pbm]
+        std::cout << "=== SITE MASK ===" << std::endl;
+        bool raw = argc >= 5;
+        std::string fullPath = (argc == 4 || argc == 6) ? argv[argc - 1] : "";
+        auto size = [](const std::string& text) {
+            try {
+                size_t used = 0;
+                int value = std::stoi(text, &used);
+                if (used == text.size()) return value;
+            } catch (const std::logic_error&) {
+            }
+            throw std::invalid_argument("Not a mask size: " + text);
+        };
+        return reportingErrors([&]() {
+            if (raw) {
+                runSiteMask(SiteMask(argv[2], size(argv[3]), size(argv[4])), fullPath);
+            } else {
+                runSiteMask(SiteMask(argv[2]), fullPath);
+            }
+        }, "percolation mask <file.pbm> [full.pbm] | mask <file.raw> <width> <height> [full.pbm]");
+    } else if (argc == 3 && std::string(argv[1]) == "trials") {
+        std::cout << "=== TRIAL FILE ===" << std::endl;
+        return reportingErrors([&]() { runTrialFileSummary(argv[2]); });
+    } else if ((argc == 4 || argc == 5) && std::string(argv[1]) == "threads") {
+        int n = std::stoi(argv[2]);
+        int trialsPerThread = std::stoi(argv[3]);
+        int maxThreads = argc == 5 ? std::stoi(argv[4]) : 0;
+        
+        std::cout << "=== THREAD SCALING ===" << std::endl;
+        runThreadScaling(n, trialsPerThread, maxThreads);
+        return 0;
+    } else if (argc == 4 && (std::string(argv[1]) == "hwcounters" || std::string(argv[1]) == "counters")) {
+        // "counters" is the mode's older name
+        int n = std::stoi(argv[2]);
+        int trials = std::stoi(argv[3]);
+        
+        std::cout << "=== HARDWARE COUNTERS ===" << std::endl;
+        runHardwareCounters(n, trials);
+        return 0;
+    } else if (argc == 5 && std::string(argv[1]) == "pipeline") {
+        int n = std::stoi(argv[2]);
+        int trials = std::stoi(argv[3]);
+        int threads = std::stoi(argv[4]);
+        
+        std::cout << "=== PIPELINED EXECUTION ===" << std::endl;
+        runPercolationStats(n, trials, threads, true);
+        return 0;
+    } else if (argc == 3 || argc == 4) {
         int n = std::stoi(argv[1]);
         int trials = std::stoi(argv[2]);
+        int threads = argc == 4 ? std::stoi(argv[3]) : 1;
         
         std::cout << "=== COMMAND LINE EXECUTION ===" << std::endl;
-        runPercolationStats(n, trials);
+        runPercolationStats(n, trials, threads, false, true);
     } else {
         // Default examples from assignment
         std::cout << "=== EXAMPLE RUNS ===" << std::endl;